@@ -0,0 +1,417 @@
+/***
+  This file is part of libblake2
+
+  Copyright 2015 Mirco Tischler
+
+  libblake2 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  libblake2 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with libblake2; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#include "Argon2.hpp"
+#include "Blake2b.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Blake2 {
+
+using std::array;
+using std::invalid_argument;
+using std::min;
+using std::string;
+using std::thread;
+using std::vector;
+
+// local typedefs
+using block_t = array<uint64_t, 128>;
+using hash_t = Blake2b::hash_t;
+
+// the temporaries of fill_block(), kept by the caller so they can be wiped
+// once instead of after every block
+struct Scratch {
+	block_t r;
+	block_t z;
+};
+
+static const uint32_t version = 0x13;
+static const uint32_t type_id = 2;
+static const uint32_t sync_points = 4;
+static const uint32_t addresses_in_block = 128;
+static const size_t block_size = 1024;
+
+// forward declarations of static methods
+static void fill_block(const block_t &prev, const block_t &ref, block_t &next, const bool &with_xor, Scratch &scratch);
+static void next_addresses(block_t &address, block_t &input, Scratch &scratch);
+static void permute(
+		    uint64_t &v0, uint64_t &v1, uint64_t &v2, uint64_t &v3,
+		    uint64_t &v4, uint64_t &v5, uint64_t &v6, uint64_t &v7,
+		    uint64_t &v8, uint64_t &v9, uint64_t &v10, uint64_t &v11,
+		    uint64_t &v12, uint64_t &v13, uint64_t &v14, uint64_t &v15);
+static void G(uint64_t &a, uint64_t &b, uint64_t &c, uint64_t &d);
+static constexpr uint64_t ror(const uint64_t &val, const size_t &n);
+static string le32(const uint32_t &val);
+static void update_with_length(Blake2b &b, const string &data);
+static block_t load_block(const vector<uint8_t> &data);
+static void wipe(void *data, const size_t &len);
+
+//
+// implementations
+//
+
+Argon2id::Argon2id(const uint32_t &time_cost,
+		   const uint32_t &memory_cost,
+		   const uint32_t &parallelism,
+		   const uint32_t &tag_length) :
+	time_cost(time_cost),
+	memory_cost(memory_cost),
+	parallelism(parallelism),
+	tag_length(tag_length) {
+	if (time_cost < 1)
+		throw invalid_argument("time cost must be at least 1");
+	if (parallelism < 1 || parallelism > 0xffffff)
+		throw invalid_argument("invalid parallelism");
+	if (memory_cost < 8 * parallelism)
+		throw invalid_argument("memory cost must be at least 8 KiB per lane");
+	if (tag_length < 4)
+		throw invalid_argument("tag length must be at least 4");
+
+	// round down to a multiple of sync_points blocks per lane
+	segment_length = memory_cost / (parallelism * sync_points);
+	lane_length = segment_length * sync_points;
+}
+
+vector<uint8_t> Argon2id::operator()(const string &password, const string &salt) const {
+	return (*this)(password, salt, string(), string());
+}
+
+vector<uint8_t> Argon2id::operator()(const string &password,
+				     const string &salt,
+				     const string &secret,
+				     const string &associated_data) const {
+	if (salt.size() < 8)
+		throw invalid_argument("salt must be at least 8 bytes");
+
+	auto b = Blake2b();
+	b.update(le32(parallelism));
+	b.update(le32(tag_length));
+	b.update(le32(memory_cost));
+	b.update(le32(time_cost));
+	b.update(le32(version));
+	b.update(le32(type_id));
+	update_with_length(b, password);
+	update_with_length(b, salt);
+	update_with_length(b, secret);
+	update_with_length(b, associated_data);
+	auto h0 = b.final();
+	wipe(&b, sizeof(b));
+
+	// room for the lane and block numbers appended to h0
+	auto seed = string(72, '\0');
+	memcpy(&seed[0], h0.data(), 64);
+	wipe(h0.data(), sizeof(h0));
+
+	auto memory = vector<block_t>(static_cast<size_t> (lane_length) * parallelism);
+	for (auto lane = 0u; lane < parallelism; ++lane) {
+		auto first = lane * static_cast<size_t> (lane_length);
+		for (auto i = 0u; i < 2; ++i) {
+			seed.replace(64, 8, le32(i) + le32(lane));
+			auto block = hash_long(block_size, seed);
+			memory[first + i] = load_block(block);
+			wipe(block.data(), block.size());
+		}
+	}
+	wipe(&seed[0], seed.size());
+
+	// lanes only depend on each other at the end of a slice
+	for (auto pass = 0u; pass < time_cost; ++pass) {
+		for (auto slice = 0u; slice < sync_points; ++slice) {
+			if (parallelism == 1) {
+				fill_segment(memory, Position{pass, 0, slice});
+				continue;
+			}
+
+			auto threads = vector<thread>();
+			threads.reserve(parallelism);
+			try {
+				for (auto lane = 0u; lane < parallelism; ++lane)
+					threads.emplace_back([this, &memory, pass, lane, slice]() {
+						fill_segment(memory, Position{pass, lane, slice});
+					});
+			} catch (...) {
+				// the started lanes still use memory
+				for (auto &t : threads)
+					t.join();
+				wipe(memory.data(), memory.size() * sizeof(block_t));
+				throw;
+			}
+			for (auto &t : threads)
+				t.join();
+		}
+	}
+
+	auto last = memory[lane_length - 1];
+	for (auto lane = 1u; lane < parallelism; ++lane) {
+		const auto &block = memory[lane * static_cast<size_t> (lane_length) + lane_length - 1];
+		for (auto i = 0u; i < last.size(); ++i)
+			last[i] ^= block[i];
+	}
+
+	auto final_block = string(reinterpret_cast<const char *> (last.data()), block_size);
+	auto tag = hash_long(tag_length, final_block);
+
+	// don't leave the password derived memory around. explicit_bzero() is
+	// not removed as a dead store like a plain fill would be
+	wipe(memory.data(), memory.size() * sizeof(block_t));
+	wipe(last.data(), sizeof(last));
+	wipe(&final_block[0], final_block.size());
+
+	return tag;
+}
+
+vector<uint8_t> Argon2id::hash_long(const uint32_t &length, const string &data) {
+	assert(length > 0);
+
+	auto b = Blake2b();
+	b.set_digest_length(min(length, 64u));
+	b.update(le32(length));
+	b.update(data);
+	auto v = b.final();
+	auto bytes = reinterpret_cast<const uint8_t *> (v.data());
+
+	if (length <= 64) {
+		auto result = vector<uint8_t>(bytes, bytes + length);
+		wipe(&b, sizeof(b));
+		wipe(v.data(), sizeof(v));
+		return result;
+	}
+
+	// chain full 64 byte hashes and keep the first half of each, the last
+	// one is shortened to produce exactly length bytes
+	auto result = vector<uint8_t>();
+	result.reserve(length);
+	auto r = (length + 31) / 32 - 2;
+	for (auto i = 1u; i < r; ++i) {
+		result.insert(result.end(), bytes, bytes + 32);
+		v = b(reinterpret_cast<const char *> (v.data()), 64);
+	}
+	result.insert(result.end(), bytes, bytes + 32);
+
+	auto rest = length - 32 * r;
+	b.set_digest_length(rest);
+	v = b(reinterpret_cast<const char *> (v.data()), 64);
+	result.insert(result.end(), bytes, bytes + rest);
+
+	wipe(&b, sizeof(b));
+	wipe(v.data(), sizeof(v));
+	return result;
+}
+
+void Argon2id::fill_segment(vector<block_t> &memory, const Position &position) const {
+	// argon2id uses data independent addressing in the first half of the
+	// first pass and data dependent addressing afterwards
+	auto data_independent = position.pass == 0 && position.slice < sync_points / 2;
+
+	auto address = block_t();
+	auto input = block_t();
+	auto scratch = Scratch();
+	if (data_independent) {
+		input.fill(0);
+		input[0] = position.pass;
+		input[1] = position.lane;
+		input[2] = position.slice;
+		input[3] = lane_length * parallelism;
+		input[4] = time_cost;
+		input[5] = type_id;
+	}
+
+	auto start = 0u;
+	if (position.pass == 0 && position.slice == 0) {
+		// the first two blocks of every lane are already initialized
+		start = 2;
+		if (data_independent)
+			next_addresses(address, input, scratch);
+	}
+
+	auto lane_start = position.lane * static_cast<size_t> (lane_length);
+	for (auto i = start; i < segment_length; ++i) {
+		auto column = position.slice * segment_length + i;
+		auto prev = lane_start + (column == 0 ? lane_length - 1 : column - 1);
+
+		uint64_t pseudo_rand;
+		if (data_independent) {
+			if (i % addresses_in_block == 0)
+				next_addresses(address, input, scratch);
+			pseudo_rand = address[i % addresses_in_block];
+		} else {
+			pseudo_rand = memory[prev][0];
+		}
+
+		auto ref_lane = static_cast<uint32_t> ((pseudo_rand >> 32) % parallelism);
+		if (position.pass == 0 && position.slice == 0)
+			ref_lane = position.lane;
+
+		auto ref_index = reference_index(position, i, static_cast<uint32_t> (pseudo_rand), ref_lane == position.lane);
+		const auto &ref = memory[ref_lane * static_cast<size_t> (lane_length) + ref_index];
+
+		fill_block(memory[prev], ref, memory[lane_start + column], position.pass != 0, scratch);
+	}
+
+	wipe(&scratch, sizeof(scratch));
+}
+
+uint32_t Argon2id::reference_index(const Position &position,
+				   const uint32_t &index,
+				   const uint32_t &pseudo_rand,
+				   const bool &same_lane) const {
+	// the number of blocks that may be referenced. blocks of the current
+	// segment in other lanes and the previous block are excluded
+	uint32_t area;
+	if (position.pass == 0) {
+		if (position.slice == 0)
+			area = index - 1;
+		else if (same_lane)
+			area = position.slice * segment_length + index - 1;
+		else
+			area = position.slice * segment_length - (index == 0 ? 1 : 0);
+	} else {
+		if (same_lane)
+			area = lane_length - segment_length + index - 1;
+		else
+			area = lane_length - segment_length - (index == 0 ? 1 : 0);
+	}
+
+	// map pseudo_rand non uniformly, preferring recent blocks
+	auto x = (static_cast<uint64_t> (pseudo_rand) * pseudo_rand) >> 32;
+	auto relative = area - 1 - static_cast<uint32_t> ((static_cast<uint64_t> (area) * x) >> 32);
+
+	auto start = 0u;
+	if (position.pass != 0 && position.slice != sync_points - 1)
+		start = (position.slice + 1) * segment_length;
+
+	return static_cast<uint32_t> ((static_cast<uint64_t> (start) + relative) % lane_length);
+}
+
+// the compression function G of RFC 9106: the BLAKE2b round without
+// message words applied to the rows and then the columns of the block
+static void fill_block(const block_t &prev, const block_t &ref, block_t &next, const bool &with_xor, Scratch &scratch) {
+	auto &r = scratch.r;
+	for (auto i = 0u; i < r.size(); ++i)
+		r[i] = prev[i] ^ ref[i];
+
+	auto &z = scratch.z;
+	z = r;
+	for (auto i = 0u; i < 8; ++i) {
+		auto v = &z[16 * i];
+		permute(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7],
+			v[8], v[9], v[10], v[11], v[12], v[13], v[14], v[15]);
+	}
+	for (auto i = 0u; i < 8; ++i) {
+		auto v = &z[2 * i];
+		permute(v[0], v[1], v[16], v[17], v[32], v[33], v[48], v[49],
+			v[64], v[65], v[80], v[81], v[96], v[97], v[112], v[113]);
+	}
+
+	for (auto i = 0u; i < next.size(); ++i) {
+		if (with_xor)
+			next[i] ^= z[i] ^ r[i];
+		else
+			next[i] = z[i] ^ r[i];
+	}
+}
+
+static void next_addresses(block_t &address, block_t &input, Scratch &scratch) {
+	auto zero = block_t();
+	zero.fill(0);
+
+	++input[6];
+	fill_block(zero, input, address, false, scratch);
+	auto tmp = address;
+	fill_block(zero, tmp, address, false, scratch);
+}
+
+static void permute(
+		    uint64_t &v0, uint64_t &v1, uint64_t &v2, uint64_t &v3,
+		    uint64_t &v4, uint64_t &v5, uint64_t &v6, uint64_t &v7,
+		    uint64_t &v8, uint64_t &v9, uint64_t &v10, uint64_t &v11,
+		    uint64_t &v12, uint64_t &v13, uint64_t &v14, uint64_t &v15) {
+	// rows
+	G(v0, v4, v8, v12);
+	G(v1, v5, v9, v13);
+	G(v2, v6, v10, v14);
+	G(v3, v7, v11, v15);
+
+	// diagonals
+	G(v0, v5, v10, v15);
+	G(v1, v6, v11, v12);
+	G(v2, v7, v8, v13);
+	G(v3, v4, v9, v14);
+}
+
+// the BLAKE2b G function with the additions replaced by the multiplication
+// hardened BlaMka function
+static uint64_t blamka(const uint64_t &x, const uint64_t &y) {
+	return x + y + 2 * (x & 0xffffffffULL) * (y & 0xffffffffULL);
+}
+
+static void G(uint64_t &a, uint64_t &b, uint64_t &c, uint64_t &d) {
+	a = blamka(a, b);
+	d = ror((d ^ a), 32u);
+	c = blamka(c, d);
+	b = ror((b ^ c), 24u);
+	a = blamka(a, b);
+	d = ror((d ^ a), 16u);
+	c = blamka(c, d);
+	b = ror((b ^ c), 63u);
+}
+
+static constexpr uint64_t ror(const uint64_t &val, const size_t &n) {
+	return(val >> n) | (val << (sizeof(uint64_t) * CHAR_BIT - n));
+}
+
+static string le32(const uint32_t &val) {
+	auto result = string(4, '\0');
+	for (auto i = 0u; i < 4; ++i)
+		result[i] = static_cast<char> (val >> (8 * i));
+	return result;
+}
+
+// without building a copy of data, it may be the password
+static void update_with_length(Blake2b &b, const string &data) {
+	b.update(le32(static_cast<uint32_t> (data.size())));
+	b.update(data);
+}
+
+static block_t load_block(const vector<uint8_t> &data) {
+	assert(data.size() == block_size);
+
+	auto block = block_t();
+	for (auto i = 0u; i < block.size(); ++i) {
+		block[i] = 0;
+		for (auto j = 0u; j < 8; ++j)
+			block[i] |= static_cast<uint64_t> (data[8 * i + j]) << (8 * j);
+	}
+	return block;
+}
+
+static void wipe(void *data, const size_t &len) {
+	explicit_bzero(data, len);
+}
+
+} // namespace Blake2
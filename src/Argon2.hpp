@@ -0,0 +1,78 @@
+/***
+  This file is part of libblake2
+
+  Copyright 2015 Mirco Tischler
+
+  libblake2 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  libblake2 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with libblake2; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Blake2 {
+
+using std::array;
+using std::string;
+using std::vector;
+
+// Argon2id password hashing as specified in RFC 9106, version 0x13.
+// The lanes of every slice are filled on their own threads.
+class Argon2id {
+    public:
+	// time_cost is the number of passes, memory_cost the memory size in
+	// KiB and parallelism the number of lanes
+	Argon2id(const uint32_t &time_cost,
+		 const uint32_t &memory_cost,
+		 const uint32_t &parallelism,
+		 const uint32_t &tag_length);
+
+	vector<uint8_t> operator()(const string &password, const string &salt) const;
+	vector<uint8_t> operator()(const string &password,
+				   const string &salt,
+				   const string &secret,
+				   const string &associated_data) const;
+
+	// the variable length hash function H' of RFC 9106
+	static vector<uint8_t> hash_long(const uint32_t &length, const string &data);
+
+    private:
+	using block_t = array<uint64_t, 128>;
+
+	struct Position {
+		uint32_t pass;
+		uint32_t lane;
+		uint32_t slice;
+	};
+
+	void fill_segment(vector<block_t> &memory, const Position &position) const;
+	uint32_t reference_index(const Position &position,
+				 const uint32_t &index,
+				 const uint32_t &pseudo_rand,
+				 const bool &same_lane) const;
+
+	uint32_t time_cost;
+	uint32_t memory_cost;
+	uint32_t parallelism;
+	uint32_t tag_length;
+
+	// derived from memory_cost and parallelism
+	uint32_t lane_length;
+	uint32_t segment_length;
+};
+
+} // namespace Blake2
@@ -0,0 +1,290 @@
+/***
+  This file is part of libblake2
+
+  Copyright 2015 Mirco Tischler
+
+  libblake2 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  libblake2 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with libblake2; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#include "AsyncBlake2b.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Blake2 {
+
+using std::condition_variable;
+using std::current_exception;
+using std::deque;
+using std::exception_ptr;
+using std::future;
+using std::lock_guard;
+using std::make_shared;
+using std::max;
+using std::mutex;
+using std::promise;
+using std::shared_ptr;
+using std::thread;
+using std::unique_lock;
+using std::vector;
+
+// typedefs
+using hash_t = AsyncBlake2b::hash_t;
+using hash_callback_t = AsyncBlake2b::hash_callback_t;
+using done_callback_t = AsyncBlake2b::done_callback_t;
+using error_callback_t = AsyncBlake2b::error_callback_t;
+using task_t = AsyncBlake2b::task_t;
+using executor_t = AsyncBlake2b::executor_t;
+
+// the default executor, started on first use and joined at exit
+class ThreadPool {
+    public:
+
+	ThreadPool(const unsigned int &threads) : stop(false) {
+		for (auto i = 0u; i < threads; ++i)
+			workers.emplace_back([this]() {
+				run();
+			});
+	}
+
+	~ThreadPool() {
+		{
+			lock_guard<mutex> l(lock);
+			stop = true;
+		}
+		wakeup.notify_all();
+		for (auto &w : workers)
+			w.join();
+	}
+
+	void submit(const task_t &task) {
+		{
+			lock_guard<mutex> l(lock);
+			tasks.push_back(task);
+		}
+		wakeup.notify_one();
+	}
+
+    private:
+
+	void run() {
+		for (;;) {
+			task_t task;
+			{
+				unique_lock<mutex> l(lock);
+				wakeup.wait(l, [this]() {
+					return stop || !tasks.empty();
+				});
+				if (tasks.empty())
+					return;
+				task = std::move(tasks.front());
+				tasks.pop_front();
+			}
+			task();
+		}
+	}
+
+	mutex lock;
+	condition_variable wakeup;
+	deque<task_t> tasks;
+	vector<thread> workers;
+	bool stop;
+};
+
+// the drain task holds a reference to the queue, so an AsyncBlake2b can be
+// destroyed while it runs
+struct AsyncBlake2b::Queue {
+	Queue(const Blake2b &b) : b(b), running(false) { }
+
+	static void enqueue(const shared_ptr<Queue> &self, const executor_t &executor, const task_t &task);
+	void drain();
+
+	Blake2b b;
+
+	mutex lock;
+	condition_variable idle;
+	deque<task_t> tasks;
+	bool running;
+	// the thread running drain(), if any
+	thread::id drainer;
+};
+
+// forward declarations of static methods
+static void report(const error_callback_t &on_error, const exception_ptr &e);
+
+//
+// implementations
+//
+
+AsyncBlake2b::AsyncBlake2b(const Blake2b &b, const executor_t &executor) :
+	one_shot(b),
+	executor(executor),
+	queue(make_shared<Queue>(b)) {
+}
+
+AsyncBlake2b::~AsyncBlake2b() {
+	unique_lock<mutex> l(queue->lock);
+	// destroyed by one of our own callbacks, waiting would never end
+	if (queue->drainer == std::this_thread::get_id())
+		return;
+	queue->idle.wait(l, [this]() {
+		return !queue->running;
+	});
+}
+
+executor_t AsyncBlake2b::default_executor() {
+	static ThreadPool pool(max(1u, thread::hardware_concurrency()));
+
+	return [](task_t task) {
+		pool.submit(task);
+	};
+}
+
+future<hash_t> AsyncBlake2b::hash_async(const char *data, const size_t &len) const {
+	// std::function needs a copyable callable, so share the promise
+	auto p = make_shared<promise<hash_t>>();
+	auto hasher = one_shot;
+	executor([p, hasher, data, len]() {
+		try {
+			p->set_value(hasher.hash(data, len));
+		} catch (...) {
+			p->set_exception(current_exception());
+		}
+	});
+	return p->get_future();
+}
+
+void AsyncBlake2b::hash_async(const char *data, const size_t &len, const hash_callback_t &callback,
+			      const error_callback_t &on_error) const {
+	auto hasher = one_shot;
+	executor([hasher, data, len, callback, on_error]() {
+		try {
+			callback(hasher.hash(data, len));
+		} catch (...) {
+			report(on_error, current_exception());
+		}
+	});
+}
+
+future<void> AsyncBlake2b::update(const char *data, const size_t &len) {
+	auto p = make_shared<promise<void>>();
+	auto q = queue.get();
+	Queue::enqueue(queue, executor, [q, p, data, len]() {
+		try {
+			q->b.update(data, len);
+			p->set_value();
+		} catch (...) {
+			p->set_exception(current_exception());
+		}
+	});
+	return p->get_future();
+}
+
+void AsyncBlake2b::update(const char *data, const size_t &len, const done_callback_t &callback,
+			  const error_callback_t &on_error) {
+	auto q = queue.get();
+	Queue::enqueue(queue, executor, [q, data, len, callback, on_error]() {
+		try {
+			q->b.update(data, len);
+			callback();
+		} catch (...) {
+			report(on_error, current_exception());
+		}
+	});
+}
+
+future<hash_t> AsyncBlake2b::final() {
+	auto p = make_shared<promise<hash_t>>();
+	auto q = queue.get();
+	Queue::enqueue(queue, executor, [q, p]() {
+		try {
+			auto h = q->b.final();
+			q->b.reset();
+			p->set_value(h);
+		} catch (...) {
+			p->set_exception(current_exception());
+		}
+	});
+	return p->get_future();
+}
+
+void AsyncBlake2b::final(const hash_callback_t &callback, const error_callback_t &on_error) {
+	auto q = queue.get();
+	Queue::enqueue(queue, executor, [q, callback, on_error]() {
+		try {
+			auto h = q->b.final();
+			q->b.reset();
+			callback(h);
+		} catch (...) {
+			report(on_error, current_exception());
+		}
+	});
+}
+
+// incremental operations are queued here and run one at a time by a single
+// drain task on the executor
+void AsyncBlake2b::Queue::enqueue(const shared_ptr<Queue> &self, const executor_t &executor, const task_t &task) {
+	{
+		lock_guard<mutex> l(self->lock);
+		self->tasks.push_back(task);
+		if (self->running)
+			return;
+		self->running = true;
+	}
+	executor([self]() {
+		self->drain();
+	});
+}
+
+void AsyncBlake2b::Queue::drain() {
+	for (;;) {
+		task_t task;
+		{
+			lock_guard<mutex> l(lock);
+			if (tasks.empty()) {
+				running = false;
+				drainer = thread::id();
+				idle.notify_all();
+				return;
+			}
+			task = std::move(tasks.front());
+			tasks.pop_front();
+			drainer = std::this_thread::get_id();
+		}
+		// tasks catch their own exceptions, this keeps running consistent
+		// should one escape anyway
+		try {
+			task();
+		} catch (...) {
+		}
+	}
+}
+
+static void report(const error_callback_t &on_error, const exception_ptr &e) {
+	try {
+		if (on_error)
+			on_error(e);
+	} catch (...) {
+	}
+}
+
+} // namespace Blake2
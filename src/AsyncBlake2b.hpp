@@ -0,0 +1,96 @@
+/***
+  This file is part of libblake2
+
+  Copyright 2015 Mirco Tischler
+
+  libblake2 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  libblake2 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with libblake2; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#pragma once
+
+#include "Blake2b.hpp"
+
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+
+namespace Blake2 {
+
+using std::exception_ptr;
+using std::function;
+using std::future;
+using std::shared_ptr;
+
+// Runs hashing on an executor instead of the calling thread. The executor is
+// any callable taking a task, by default a thread pool owned by the library.
+//
+// Buffers passed in must stay valid until the returned future is ready or
+// the callback has run. Updates are applied in the order they were issued,
+// so a caller can read the next chunk while the previous one is being
+// hashed.
+//
+// The callback overloads invoke the callback on the executor once the work
+// is done. An event loop or a coroutine can resume from there instead of
+// blocking on a future, and may destroy the AsyncBlake2b from the callback.
+// An exception thrown by the hashing or by the callback goes to on_error,
+// exceptions thrown by on_error itself are dropped.
+//
+// A task running on the default pool must not wait for another future of
+// the pool, on a machine with few cores no thread may be left to run it.
+class BLAKE2_EXPORT_SYMBOL AsyncBlake2b {
+    public:
+	using hash_t = Blake2b::hash_t;
+	using task_t = function<void()>;
+	using executor_t = function<void(task_t)>;
+	using hash_callback_t = function<void(const hash_t &)>;
+	using done_callback_t = function<void()>;
+	using error_callback_t = function<void(exception_ptr)>;
+
+	AsyncBlake2b() : AsyncBlake2b(Blake2b()) { }
+	explicit AsyncBlake2b(const Blake2b &b) : AsyncBlake2b(b, default_executor()) { }
+	AsyncBlake2b(const Blake2b &b, const executor_t &executor);
+
+	AsyncBlake2b(const AsyncBlake2b&) = delete;
+	AsyncBlake2b& operator=(const AsyncBlake2b&) = delete;
+
+	// waits for all queued updates, unless called from one of them. then
+	// the remaining updates still run but their results are discarded
+	~AsyncBlake2b();
+
+	// one-shot hash, independent of the incremental state
+	future<hash_t> hash_async(const char *data, const size_t &len) const;
+	void hash_async(const char *data, const size_t &len, const hash_callback_t &callback,
+			const error_callback_t &on_error) const;
+
+	future<void> update(const char *data, const size_t &len);
+	void update(const char *data, const size_t &len, const done_callback_t &callback,
+		    const error_callback_t &on_error);
+	// the result of all updates so far, the state is reset afterwards
+	future<hash_t> final();
+	void final(const hash_callback_t &callback, const error_callback_t &on_error);
+
+	static executor_t default_executor();
+
+    private:
+	// the incremental state and its queue, shared with the task draining
+	// the queue so it outlives an AsyncBlake2b destroyed by a callback
+	struct Queue;
+
+	const Blake2b one_shot;
+	executor_t executor;
+	shared_ptr<Queue> queue;
+};
+
+} // namespace Blake2
@@ -25,6 +25,7 @@
 #include <cassert>
 #include <climits>
 #include <iomanip>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -36,6 +37,8 @@ using std::advance;
 using std::begin;
 using std::end;
 using std::hex;
+using std::invalid_argument;
+using std::logic_error;
 using std::memcpy;
 using std::setfill;
 using std::setw;
@@ -47,14 +50,15 @@ using std::vector;
 using hash_t = Blake2b::hash_t;
 using salt_t = Blake2b::salt_t;
 using personalization_t = Blake2b::personalization_t;
+using block_t = Blake2b::block_t;
+using counter_t = Blake2b::counter_t;
+using final_flag_t = Blake2b::final_flag_t;
 
 // declaration of static data members
 constexpr hash_t Blake2b::i_v;
 constexpr Blake2b::sigma_t Blake2b::p_m;
 
 // local typedefs
-using counter_t = array<uint64_t, 2>;
-using final_flag_t = array<uint64_t, 2>;
 template<class Container>
 using data_t = SubrangeAdaptor<Container, 16>;
 using state_vector_t = array<uint64_t, 16>;
@@ -67,28 +71,31 @@ template<class Container>
 static data_t<Container> initialize_m(const Container &data, const size_t &len);
 template<>
 data_t<const char*> initialize_m<const char *>(const char * const &data, const size_t &len);
-template<class Container>
+template<class Message>
 static hash_t compress(
 		       hash_t &h,
-		       const data_t<Container> &m,
+		       const Message &m,
 		       const array<uint64_t, 2> &t,
 		       const array<uint64_t, 2 > &f);
 static hash_t finalize(
 		       const hash_t &h,
 		       const array<uint64_t, 16> &v);
-template<class Container>
+template<class Message>
 static void round(
 		  const unsigned int &index,
 		  array<uint64_t, 16> &v,
-		  const data_t<Container> &m);
-template<class Container>
+		  const Message &m);
+template<class Message>
 static void G(
 	      const unsigned int &r,
 	      const unsigned int &i,
 	      uint64_t &a, uint64_t &b, uint64_t &c, uint64_t &d,
-	      const data_t<Container> &m);
+	      const Message &m);
 
 static constexpr uint64_t ror(const uint64_t &val, const size_t &n);
+static block_t load_block(const uint8_t *data);
+static void store64(uint8_t *dst, const uint64_t &val);
+static uint64_t load64(const uint8_t *src);
 
 //
 // impleentations
@@ -109,18 +116,11 @@ Blake2b::Blake2b(const unsigned int &digestLength,
 	// we don't support tree hashing thus don't set leaf_length
 	// node_offset, node_depth or inner_length
 
-	auto it = begin(parameter_block.pba);
-	advance(it, 8);
-	for (auto &el : salt) {
-		*it = el;
-		++it;
-	}
-
-	for (auto &el : personalization) {
+	parameter_block.pbs.salt = salt;
+	parameter_block.pbs.personalization = personalization;
 
-		*it = el;
-		++it;
-	}
+	key.fill(0);
+	reset();
 }
 
 string Blake2b::to_string(const hash_t& hash) {
@@ -135,31 +135,310 @@ string Blake2b::to_string(const hash_t& hash) {
 
 void Blake2b::set_digest_length(const size_t &digest_length) {
 	parameter_block.pbs.digest_length = static_cast<uint8_t> (digest_length);
+	reset();
+}
+
+void Blake2b::set_key(const char *key, const size_t &key_length) {
+	if (key_length > this->key.size())
+		throw invalid_argument("key too long");
+
+	this->key.fill(0);
+	memcpy(this->key.data(), key, key_length);
+	parameter_block.pbs.key_length = static_cast<uint8_t> (key_length);
+	reset();
 }
 
 void Blake2b::set_salt(const salt_t &salt) {
 	parameter_block.pbs.salt = salt;
+	reset();
 }
 
 void Blake2b::set_personalization(const personalization_t &personalization) {
 	parameter_block.pbs.personalization = personalization;
+	reset();
 }
 
 hash_t Blake2b::operator()(const string &data) {
-	return hash_internal(data, data.size());
+	return hash(data.data(), data.size());
 }
 
 hash_t Blake2b::operator()(const vector<uint64_t> &data) {
+	if (parameter_block.pbs.key_length > 0 || data.size() <= 16)
+		return hash(reinterpret_cast<const char *> (data.data()), data.size()*8);
 	return hash_internal(data, data.size()*8);
 }
 
 hash_t Blake2b::operator()(const char *data, const size_t &len) {
+	return hash(data, len);
+}
+
+hash_t Blake2b::hash(const char *data, const size_t &len) const {
+	if (len <= 128)
+		return hash_short(data, len);
+	if (parameter_block.pbs.key_length > 0)
+		return hash_keyed(data, len);
 	return hash_internal(data, len);
 }
 
+hash_t Blake2b::hash_short(const char *data, const size_t &len) const {
+	assert(len <= 128);
+
+	auto h = key_h;
+	auto t = counter_t{
+		{0, 0}
+	};
+	auto f = final_flag_t{
+		{~0ULL, 0}
+	};
+	auto m = block_t{STATE_VECTOR_INIT};
+
+	if (parameter_block.pbs.key_length > 0) {
+		// the key block alone is the final block of an empty message
+		if (len == 0) {
+			h = initialize_h();
+			t[0] = 128;
+			memcpy(m.data(), key.data(), key.size());
+			return compress(h, m, t, f);
+		}
+		t[0] = 128;
+	}
+
+	memcpy(m.data(), data, len);
+	t[0] += len;
+
+	return compress(h, m, t, f);
+}
+
+hash_t Blake2b::hash_keyed(const char *data, const size_t &len) const {
+	assert(len > 0);
+
+	// continue after the precomputed key block
+	auto keyed = *this;
+	keyed.state.h = key_h;
+	keyed.state.t = counter_t{
+		{128, 0}
+	};
+	keyed.state.f.fill(0);
+	keyed.state.buffer_length = 0;
+	keyed.update(data, len);
+	return keyed.final();
+}
+
+void Blake2b::reset() {
+	state.h = initialize_h();
+	state.t.fill(0);
+	state.f.fill(0);
+	state.buffer.fill(0);
+	state.buffer_length = 0;
+
+	// a keyed hash starts with the key padded to a full block
+	if (parameter_block.pbs.key_length > 0) {
+		memcpy(state.buffer.data(), key.data(), key.size());
+		state.buffer_length = state.buffer.size();
+	}
+
+	setup_key_h();
+}
+
+void Blake2b::setup_key_h() {
+	key_h = initialize_h();
+	if (parameter_block.pbs.key_length == 0)
+		return;
+
+	auto block = array<uint8_t, 128>();
+	block.fill(0);
+	memcpy(block.data(), key.data(), key.size());
+	auto t = counter_t{
+		{128, 0}
+	};
+	auto f = final_flag_t{
+		{0, 0}
+	};
+	key_h = compress(key_h, load_block(block.data()), t, f);
+}
+
+void Blake2b::update(const string &data) {
+	update(data.data(), data.size());
+}
+
+void Blake2b::update(const char *data, const size_t &len) {
+	if (state.f[0] != 0)
+		throw logic_error("update after final, reset first");
+
+	auto in = reinterpret_cast<const uint8_t *> (data);
+	auto remaining = len;
+
+	// only compress the buffer once we know more data follows, the last
+	// block has to be compressed by final()
+	auto fill = state.buffer.size() - state.buffer_length;
+	if (remaining > fill) {
+		memcpy(state.buffer.data() + state.buffer_length, in, fill);
+		increment_counter(128);
+		state.h = compress(state.h, load_block(state.buffer.data()), state.t, state.f);
+		state.buffer_length = 0;
+		in += fill;
+		remaining -= fill;
+
+		while (remaining > 128) {
+			increment_counter(128);
+			state.h = compress(state.h, load_block(in), state.t, state.f);
+			in += 128;
+			remaining -= 128;
+		}
+	}
+
+	memcpy(state.buffer.data() + state.buffer_length, in, remaining);
+	state.buffer_length += remaining;
+}
+
+hash_t Blake2b::final() {
+	if (state.f[0] != 0)
+		throw logic_error("final called twice, reset first");
+
+	increment_counter(state.buffer_length);
+	state.f[0] = ~0ULL;
+	std::fill(begin(state.buffer) + state.buffer_length, end(state.buffer), 0);
+	state.h = compress(state.h, load_block(state.buffer.data()), state.t, state.f);
+
+	return state.h;
+}
+
+hash_t Blake2b::final(const char *suffix, const size_t &len) const {
+	// the object is trivially copyable, a fork is just a copy of the
+	// parameter block and the state
+	auto fork = *this;
+	fork.update(suffix, len);
+	return fork.final();
+}
+
+void Blake2b::increment_counter(const uint64_t &inc) {
+	state.t[0] += inc;
+	if (state.t[0] < inc)
+		++state.t[1];
+}
+
+// Layout of a serialized state, all words little endian:
+//   0   magic "B2bS"
+//   4   format version
+//   5   number of bytes in the buffer
+//   6   flags, bit 0 set if the buffer holds the pending key block
+//   7   reserved byte, always 0
+//   8   parameter block (8 words)
+//   72  chaining value h (8 words)
+//   136 counter t (2 words)
+//   152 final flags f (2 words)
+//   168 buffer (128 bytes), zero past the number of bytes in it
+//
+// A keyed state is written without its key. Until the first block is
+// compressed the buffer is the key block, it is replaced by a flag and
+// rebuilt from the key of the importing object.
+static const uint8_t state_magic[4] = {'B', '2', 'b', 'S'};
+static const uint8_t state_version = 1;
+static const uint8_t key_block_pending = 1;
+
+vector<uint8_t> Blake2b::export_state() const {
+	auto blob = vector<uint8_t>(state_size, 0);
+	auto p = blob.data();
+
+	memcpy(p, state_magic, sizeof(state_magic));
+	p[4] = state_version;
+	p[5] = static_cast<uint8_t> (state.buffer_length);
+	auto pending = parameter_block.pbs.key_length > 0 && state.t[0] == 0 && state.t[1] == 0;
+	if (pending)
+		p[6] = key_block_pending;
+	p += 8;
+
+	for (const auto &el : parameter_block.pba) {
+		store64(p, el);
+		p += 8;
+	}
+	for (const auto &el : state.h) {
+		store64(p, el);
+		p += 8;
+	}
+	for (const auto &el : state.t) {
+		store64(p, el);
+		p += 8;
+	}
+	for (const auto &el : state.f) {
+		store64(p, el);
+		p += 8;
+	}
+	// stale bytes past the buffer length may be left over from the key
+	if (!pending)
+		memcpy(p, state.buffer.data(), state.buffer_length);
+
+	return blob;
+}
+
+void Blake2b::import_state(const uint8_t *blob, const size_t &len) {
+	if (len != state_size)
+		throw invalid_argument("invalid state size");
+	if (memcmp(blob, state_magic, sizeof(state_magic)) != 0)
+		throw invalid_argument("not a blake2b state");
+	if (blob[4] != state_version)
+		throw invalid_argument("unsupported state version");
+	if (blob[5] > 128 || (blob[6] & ~key_block_pending) != 0 || blob[7] != 0)
+		throw invalid_argument("corrupt state");
+
+	// decode into a temporary first so a bad blob leaves us untouched
+	auto p = blob + 8;
+	auto pb = ParameterBlockUnion();
+	for (auto &el : pb.pba) {
+		el = load64(p);
+		p += 8;
+	}
+	if (pb.pbs.digest_length < 1 || pb.pbs.digest_length > 64 || pb.pbs.key_length > 64)
+		throw invalid_argument("corrupt parameter block");
+
+	auto s = State();
+	for (auto &el : s.h) {
+		el = load64(p);
+		p += 8;
+	}
+	for (auto &el : s.t) {
+		el = load64(p);
+		p += 8;
+	}
+	for (auto &el : s.f) {
+		el = load64(p);
+		p += 8;
+	}
+	memcpy(s.buffer.data(), p, s.buffer.size());
+	s.buffer_length = blob[5];
+
+	// only states update() can produce: not finalized, the counter covers
+	// whole compressed blocks and a block is compressed only once more data
+	// follows, so the buffer is never empty after one
+	if (s.f[0] != 0 || s.f[1] != 0)
+		throw invalid_argument("finalized state");
+	if (s.t[0] % 128 != 0 || (s.buffer_length == 0 && (s.t[0] != 0 || s.t[1] != 0)))
+		throw invalid_argument("corrupt state");
+
+	// a keyed state needs our key, and before the first compression it
+	// must come without the key block
+	auto keyed = pb.pbs.key_length > 0;
+	auto pending = keyed && s.t[0] == 0 && s.t[1] == 0;
+	if (keyed && pb.pbs.key_length != parameter_block.pbs.key_length)
+		throw invalid_argument("key not set");
+	if (pending != ((blob[6] & key_block_pending) != 0))
+		throw invalid_argument("corrupt state");
+	if (pending) {
+		if (s.buffer_length != s.buffer.size())
+			throw invalid_argument("corrupt state");
+		s.buffer.fill(0);
+		memcpy(s.buffer.data(), key.data(), key.size());
+	}
+
+	parameter_block = pb;
+	state = s;
+	setup_key_h();
+}
+
 void Blake2b::setup_parameter_block() {
 	parameter_block.pba.fill(0);
 
+	parameter_block.pbs.digest_length = static_cast<uint8_t> (64u);
 	parameter_block.pbs.fanout = static_cast<uint8_t> (1u);
 	parameter_block.pbs.depth = static_cast<uint8_t> (1u);
 }
@@ -176,7 +455,7 @@ data_t<const char *> initialize_m<const char *>(const char *const &data, const s
 }
 
 template<class Container>
-hash_t Blake2b::hash_internal(const Container &v_m, const size_t &orig_size) {
+hash_t Blake2b::hash_internal(const Container &v_m, const size_t &orig_size) const {
 	auto h = initialize_h();
 	auto m = initialize_m(v_m, orig_size);
 	auto t = counter_t{
@@ -214,10 +493,10 @@ hash_t Blake2b::initialize_h() const {
 	return h;
 }
 
-template<class Container>
+template<class Message>
 static hash_t compress(
 		       hash_t &h,
-		       const data_t<Container> &m,
+		       const Message &m,
 		       const counter_t &t,
 		       const final_flag_t &f) {
 	// initialize the state vector
@@ -242,8 +521,8 @@ static hash_t compress(
 	return finalize(h, state_vector);
 }
 
-template<class Container>
-static void round(const unsigned int &index, state_vector_t &v, const data_t<Container> &m) {
+template<class Message>
+static void round(const unsigned int &index, state_vector_t &v, const Message &m) {
 	// rows
 	for (auto i = 0; i < 4; ++i)
 		G(index, i, v[0 + i], v[4 + i], v[8 + i], v[12 + i], m);
@@ -271,9 +550,9 @@ static hash_t finalize(const hash_t &h, const state_vector_t &v) {
 	return ret;
 }
 
-template<class Container>
+template<class Message>
 static void G(const unsigned int &r, const unsigned int &i, uint64_t &a, uint64_t &b, uint64_t &c,
-	      uint64_t &d, const data_t<Container> &m) {
+	      uint64_t &d, const Message &m) {
 	a = a + b + m[Blake2b::permutation_matrix(r, 2 * i)];
 	d = ror((d ^ a), 32u);
 	c = c + d;
@@ -288,4 +567,26 @@ static constexpr uint64_t ror(const uint64_t &val, const size_t &n) {
 	return(val >> n) | (val << (sizeof(uint64_t) * CHAR_BIT - n));
 }
 
+static block_t load_block(const uint8_t *data) {
+	auto m = block_t{STATE_VECTOR_INIT};
+	auto p = data;
+	for (auto &el : m) {
+		el = load64(p);
+		p += 8;
+	}
+	return m;
+}
+
+static void store64(uint8_t *dst, const uint64_t &val) {
+	for (auto i = 0u; i < 8; ++i)
+		dst[i] = static_cast<uint8_t> (val >> (8 * i));
+}
+
+static uint64_t load64(const uint8_t *src) {
+	auto val = uint64_t{0};
+	for (auto i = 0u; i < 8; ++i)
+		val |= static_cast<uint64_t> (src[i]) << (8 * i);
+	return val;
+}
+
 } // namespace Blake2
@@ -19,8 +19,11 @@
 
 #pragma once
 
+#include "blake2b.h"
+
 #include <array>
 #include <cassert>
+#include <cstdint>
 #include <cstring>
 #include <string>
 #include <vector>
@@ -33,11 +36,17 @@ using std::memcpy;
 using std::string;
 using std::vector;
 
-class Blake2b {
+class BLAKE2_EXPORT_SYMBOL Blake2b {
     public:
 	using hash_t = array<uint64_t, 8>;
 	using salt_t = array<uint64_t, 2>;
 	using personalization_t = array<uint64_t, 2>;
+	using block_t = array<uint64_t, 16>;
+	using counter_t = array<uint64_t, 2>;
+	using final_flag_t = array<uint64_t, 2>;
+
+	// size of a serialized midstate as written by export_state()
+	static constexpr size_t state_size = 296;
 
 	Blake2b(const unsigned int &digestLength,
 		const unsigned int &keyLength,
@@ -46,17 +55,49 @@ class Blake2b {
 
 	Blake2b() {
 		setup_parameter_block();
+		key.fill(0);
+		reset();
 	}
 
 
 	hash_t operator()(const string &data);
 	hash_t operator()(const vector<uint64_t> &data);
 	hash_t operator()(const char *data, const size_t &len);
+	hash_t hash(const char *data, const size_t &len) const;
+
+	// messages of at most one block (128 bytes) are hashed with a single
+	// compression, keyed hashes start from the precomputed key block
+	hash_t hash_short(const char *data, const size_t &len) const;
 
 	void set_digest_length(const size_t &digest_length);
+	void set_key(const char *key, const size_t &key_length);
 	void set_salt(const salt_t &salt);
 	void set_personalization(const personalization_t &personalization);
 
+	bool is_keyed() const {
+		return parameter_block.pbs.key_length > 0;
+	}
+
+	// incremental interface, independent of the one-shot operator()
+	// changing any parameter restarts the incremental state. after final()
+	// update() and final() throw logic_error until reset() is called
+	void reset();
+	void update(const char *data, const size_t &len);
+	void update(const string &data);
+	hash_t final();
+
+	// finish the hash of the data absorbed so far followed by suffix
+	// without modifying this object. absorb a shared prefix once with
+	// update() and call this for every message starting with it
+	hash_t final(const char *suffix, const size_t &len) const;
+
+	// the midstate including the parameter block as a portable byte blob,
+	// suitable to checkpoint a long running hash and resume it later.
+	// the key is not part of the blob, set it before importing a keyed
+	// state. import_state() throws invalid_argument on a bad blob
+	vector<uint8_t> export_state() const;
+	void import_state(const uint8_t *blob, const size_t &len);
+
 	static uint64_t initialization_vector(const size_t &i) {
 		assert(i < 8);
 		return i_v[i];
@@ -75,7 +116,10 @@ class Blake2b {
 	void setup_parameter_block();
 	hash_t initialize_h() const;
 	template<class Container>
-	hash_t hash_internal(const Container &v_m, const size_t &orig_size);
+	hash_t hash_internal(const Container &v_m, const size_t &orig_size) const;
+	hash_t hash_keyed(const char *data, const size_t &len) const;
+	void increment_counter(const uint64_t &inc);
+	void setup_key_h();
 
 	static constexpr auto i_v = hash_t{
 		{
@@ -165,6 +209,22 @@ class Blake2b {
 	};
 	ParameterBlockUnion parameter_block;
 
+	// the key, zero padded. key_h is the chaining value after the key block
+	// has been absorbed, or the initial chaining value for unkeyed hashes
+	array<uint8_t, 64> key;
+	hash_t key_h;
+
+	// the in-progress state of the incremental interface. the last block
+	// is always kept in the buffer as it may need the final flag set
+	struct State {
+		hash_t h;
+		counter_t t;
+		final_flag_t f;
+		array<uint8_t, 128> buffer;
+		size_t buffer_length;
+	};
+	State state;
+
 	static_assert(sizeof(struct ParameterBlock) == sizeof(array<uint64_t, 8>), "size mismatch");
 };
 
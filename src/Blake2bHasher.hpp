@@ -0,0 +1,75 @@
+/***
+  This file is part of libblake2
+
+  Copyright 2015 Mirco Tischler
+
+  libblake2 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  libblake2 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with libblake2; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#pragma once
+
+#include "Blake2b.hpp"
+
+#include <array>
+#include <random>
+#include <string>
+#include <type_traits>
+
+namespace Blake2 {
+
+using std::array;
+using std::string;
+
+// Keyed BLAKE2b with a 64 bit digest, usable as the Hasher of the
+// unordered containers. A default constructed hasher draws a random key so
+// an attacker can't precompute colliding keys.
+class Blake2bHasher {
+    public:
+	using key_t = array<uint8_t, 16>;
+
+	Blake2bHasher() : Blake2bHasher(random_key()) { }
+
+	explicit Blake2bHasher(const key_t &key) {
+		b.set_digest_length(8);
+		b.set_key(reinterpret_cast<const char *> (key.data()), key.size());
+	}
+
+	size_t operator()(const string &data) const {
+		return (*this)(data.data(), data.size());
+	}
+
+	size_t operator()(const char *data, const size_t &len) const {
+		return static_cast<size_t> (b.hash(data, len)[0]);
+	}
+
+	// integral and enum types only: equal floating point values may differ
+	// in their bytes (0.0 and -0.0) and long double has padding
+	template<class T, class = typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type>
+	size_t operator()(const T &value) const {
+		return (*this)(reinterpret_cast<const char *> (&value), sizeof(value));
+	}
+
+    private:
+	static key_t random_key() {
+		std::random_device rd;
+		auto key = key_t();
+		for (auto &el : key)
+			el = static_cast<uint8_t> (rd());
+		return key;
+	}
+
+	Blake2b b;
+};
+
+} // namespace Blake2
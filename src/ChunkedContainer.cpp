@@ -0,0 +1,346 @@
+/***
+  This file is part of libblake2
+
+  Copyright 2015 Mirco Tischler
+
+  libblake2 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  libblake2 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with libblake2; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#include "ChunkedContainer.hpp"
+#include "AsyncBlake2b.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <exception>
+#include <future>
+#include <limits>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Blake2 {
+
+using std::array;
+using std::current_exception;
+using std::future;
+using std::invalid_argument;
+using std::make_shared;
+using std::max;
+using std::memcmp;
+using std::memcpy;
+using std::min;
+using std::numeric_limits;
+using std::out_of_range;
+using std::promise;
+using std::random_device;
+using std::string;
+using std::thread;
+using std::vector;
+
+// typedefs
+using tag_t = ChunkedContainer::tag_t;
+using salt_t = ChunkedContainer::salt_t;
+using personalization_t = ChunkedContainer::personalization_t;
+using nonce_t = ChunkedContainer::nonce_t;
+using Header = ChunkedContainer::Header;
+
+// declaration of static data members
+constexpr size_t ChunkedContainer::header_size;
+constexpr size_t ChunkedContainer::tag_size;
+constexpr size_t ChunkedContainer::default_chunk_size;
+
+static const char magic[4] = {'B', '2', 'b', 'F'};
+static const uint32_t version = 2;
+
+// the domains of the trailer hashed after a chunk or the chunk tags
+static const uint32_t chunk_domain = 0;
+static const uint32_t root_domain = 1;
+
+// chunks are tagged on the thread pool once there are this many
+static const uint64_t parallel_chunks = 4;
+
+// the size of the trailer hashed after a chunk or the chunk tags
+static const size_t trailer_size = 40;
+
+// forward declarations of static methods
+static void store32(char *p, const uint32_t &v);
+static void store64(char *p, const uint64_t &v);
+static uint32_t load32(const char *p);
+static uint64_t load64(const char *p);
+static bool equal_tags(const char *a, const char *b);
+static array<char, trailer_size> trailer(const Header &header, const uint64_t &index, const uint32_t &domain);
+
+//
+// implementations
+//
+
+uint64_t Header::chunk_count() const {
+	return (data_length + chunk_size - 1) / chunk_size;
+}
+
+uint64_t Header::root_offset() const {
+	return ChunkedContainer::header_size;
+}
+
+uint64_t Header::tag_offset(const uint64_t &chunk) const {
+	return root_offset() + ChunkedContainer::tag_size * (1 + chunk);
+}
+
+uint64_t Header::chunk_offset(const uint64_t &chunk) const {
+	return tag_offset(chunk_count()) + chunk * chunk_size;
+}
+
+uint64_t Header::chunk_length(const uint64_t &chunk) const {
+	return min<uint64_t>(chunk_size, data_length - chunk * chunk_size);
+}
+
+uint64_t Header::container_length() const {
+	return tag_offset(chunk_count()) + data_length;
+}
+
+ChunkedContainer::ChunkedContainer(const string &key,
+				   const salt_t &salt,
+				   const personalization_t &personalization,
+				   const uint32_t &chunk_size) :
+	b(64, 0, salt, personalization),
+	chunk_size(chunk_size) {
+	if (key.empty())
+		throw invalid_argument("a key is required");
+	if (chunk_size == 0)
+		throw invalid_argument("invalid chunk size");
+	b.set_key(key.data(), key.size());
+}
+
+string ChunkedContainer::encode(const char *data, const size_t &len) const {
+	return encode(data, len, random_nonce());
+}
+
+string ChunkedContainer::encode(const string &data) const {
+	return encode(data.data(), data.size());
+}
+
+string ChunkedContainer::encode(const char *data, const size_t &len, const nonce_t &nonce) const {
+	auto header = Header{chunk_size, len, nonce};
+	auto tags = chunk_tags(header, data);
+	auto root = root_tag(header, tags);
+
+	auto container = string(header.container_length(), '\0');
+	auto p = &container[0];
+	memcpy(p, magic, sizeof(magic));
+	store32(p + 4, version);
+	store32(p + 8, chunk_size);
+	store64(p + 16, len);
+	store64(p + 24, nonce[0]);
+	store64(p + 32, nonce[1]);
+
+	memcpy(p + header.root_offset(), root.data(), tag_size);
+	for (auto i = uint64_t{0}; i < tags.size(); ++i)
+		memcpy(p + header.tag_offset(i), tags[i].data(), tag_size);
+	if (len > 0)
+		memcpy(p + header.chunk_offset(0), data, len);
+
+	return container;
+}
+
+string ChunkedContainer::decode(const string &container) const {
+	auto header = parse_header(container.data(), container.size());
+	if (header.chunk_size != chunk_size || header.container_length() != container.size())
+		throw invalid_argument("malformed container");
+
+	auto data = container.data() + header.chunk_offset(0);
+	auto tags = chunk_tags(header, data);
+	for (auto i = uint64_t{0}; i < tags.size(); ++i) {
+		if (!equal_tags(reinterpret_cast<const char *> (tags[i].data()), container.data() + header.tag_offset(i)))
+			throw invalid_argument("chunk authentication failed");
+	}
+
+	auto root = root_tag(header, tags);
+	if (!equal_tags(reinterpret_cast<const char *> (root.data()), container.data() + header.root_offset()))
+		throw invalid_argument("root authentication failed");
+
+	return string(data, header.data_length);
+}
+
+bool ChunkedContainer::verify(const string &container) const {
+	try {
+		decode(container);
+		return true;
+	} catch (invalid_argument &e) {
+		return false;
+	}
+}
+
+string ChunkedContainer::read_range(const string &container, const uint64_t &offset, const size_t &len) const {
+	auto header = parse_header(container.data(), container.size());
+	if (header.chunk_size != chunk_size || header.container_length() != container.size())
+		throw invalid_argument("malformed container");
+	if (offset > header.data_length || len > header.data_length - offset)
+		throw out_of_range("range out of range");
+	if (len == 0)
+		return string();
+
+	auto first = offset / chunk_size;
+	auto last = (offset + len - 1) / chunk_size;
+	for (auto i = first; i <= last; ++i) {
+		if (!verify_chunk(header, i, container.data() + header.chunk_offset(i), header.chunk_length(i),
+				  container.data() + header.tag_offset(i)))
+			throw invalid_argument("chunk authentication failed");
+	}
+
+	return container.substr(header.chunk_offset(0) + offset, len);
+}
+
+Header ChunkedContainer::parse_header(const char *data, const size_t &len) {
+	if (len < header_size || memcmp(data, magic, sizeof(magic)) != 0)
+		throw invalid_argument("not a chunked container");
+	if (load32(data + 4) != version)
+		throw invalid_argument("unsupported container version");
+
+	auto header = Header{load32(data + 8), load64(data + 16), nonce_t{{load64(data + 24), load64(data + 32)}}};
+	if (header.chunk_size == 0)
+		throw invalid_argument("invalid chunk size");
+
+	// the chunk count and the container length must not wrap around
+	const auto max = numeric_limits<uint64_t>::max();
+	if (header.data_length > max - (header.chunk_size - 1))
+		throw invalid_argument("invalid data length");
+	if (header.chunk_count() > (max - header_size) / tag_size - 1)
+		throw invalid_argument("invalid data length");
+	if (header.data_length > max - header.tag_offset(header.chunk_count()))
+		throw invalid_argument("invalid data length");
+
+	return header;
+}
+
+tag_t ChunkedContainer::chunk_tag(const Header &header, const uint64_t &chunk, const char *data, const size_t &len) const {
+	assert(chunk < header.chunk_count());
+	assert(len == header.chunk_length(chunk));
+
+	auto t = trailer(header, chunk, chunk_domain);
+	auto hasher = b;
+	hasher.update(data, len);
+	return hasher.final(t.data(), t.size());
+}
+
+tag_t ChunkedContainer::root_tag(const Header &header, const vector<tag_t> &tags) const {
+	assert(tags.size() == header.chunk_count());
+
+	auto t = trailer(header, tags.size(), root_domain);
+	auto hasher = b;
+	for (const auto &tag : tags)
+		hasher.update(reinterpret_cast<const char *> (tag.data()), tag_size);
+	return hasher.final(t.data(), t.size());
+}
+
+bool ChunkedContainer::verify_chunk(const Header &header, const uint64_t &chunk, const char *data, const size_t &len, const char *tag) const {
+	if (chunk >= header.chunk_count() || len != header.chunk_length(chunk))
+		return false;
+
+	auto expected = chunk_tag(header, chunk, data, len);
+	return equal_tags(reinterpret_cast<const char *> (expected.data()), tag);
+}
+
+nonce_t ChunkedContainer::random_nonce() {
+	random_device rd;
+	auto nonce = nonce_t();
+	for (auto &el : nonce)
+		el = static_cast<uint64_t> (rd()) << 32 | rd();
+	return nonce;
+}
+
+vector<tag_t> ChunkedContainer::chunk_tags(const Header &header, const char *data) const {
+	auto count = header.chunk_count();
+	auto tags = vector<tag_t>(count);
+
+	auto parts = min<uint64_t>(max(1u, thread::hardware_concurrency()), count);
+	if (count < parallel_chunks || parts <= 1) {
+		for (auto i = uint64_t{0}; i < count; ++i)
+			tags[i] = chunk_tag(header, i, data + i * chunk_size, header.chunk_length(i));
+		return tags;
+	}
+
+	// chunks are independent, every worker of the library's thread pool
+	// tags a contiguous range of them
+	auto executor = AsyncBlake2b::default_executor();
+	auto pending = vector<future<void>>();
+	for (auto part = uint64_t{0}; part < parts; ++part) {
+		auto first = count * part / parts;
+		auto last = count * (part + 1) / parts;
+		auto p = make_shared<promise<void>>();
+		pending.push_back(p->get_future());
+		executor([this, p, &tags, &header, first, last, data]() {
+			try {
+				for (auto i = first; i < last; ++i)
+					tags[i] = chunk_tag(header, i, data + i * chunk_size, header.chunk_length(i));
+				p->set_value();
+			} catch (...) {
+				p->set_exception(current_exception());
+			}
+		});
+	}
+	for (auto &f : pending)
+		f.get();
+
+	return tags;
+}
+
+// no early exit, the time taken must not depend on the tags
+static bool equal_tags(const char *a, const char *b) {
+	auto diff = 0;
+	for (auto i = size_t{0}; i < ChunkedContainer::tag_size; ++i)
+		diff |= a[i] ^ b[i];
+	return diff == 0;
+}
+
+// index, data length, chunk size, domain and nonce
+static array<char, trailer_size> trailer(const Header &header, const uint64_t &index, const uint32_t &domain) {
+	auto t = array<char, trailer_size>();
+	store64(t.data(), index);
+	store64(t.data() + 8, header.data_length);
+	store32(t.data() + 16, header.chunk_size);
+	store32(t.data() + 20, domain);
+	store64(t.data() + 24, header.nonce[0]);
+	store64(t.data() + 32, header.nonce[1]);
+	return t;
+}
+
+static void store32(char *p, const uint32_t &v) {
+	for (auto i = 0u; i < 4; ++i)
+		p[i] = static_cast<char> (v >> (8 * i));
+}
+
+static void store64(char *p, const uint64_t &v) {
+	for (auto i = 0u; i < 8; ++i)
+		p[i] = static_cast<char> (v >> (8 * i));
+}
+
+static uint32_t load32(const char *p) {
+	auto v = uint32_t{0};
+	for (auto i = 0u; i < 4; ++i)
+		v |= static_cast<uint32_t> (static_cast<uint8_t> (p[i])) << (8 * i);
+	return v;
+}
+
+static uint64_t load64(const char *p) {
+	auto v = uint64_t{0};
+	for (auto i = 0u; i < 8; ++i)
+		v |= static_cast<uint64_t> (static_cast<uint8_t> (p[i])) << (8 * i);
+	return v;
+}
+
+} // namespace Blake2
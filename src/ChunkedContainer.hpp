@@ -0,0 +1,110 @@
+/***
+  This file is part of libblake2
+
+  Copyright 2015 Mirco Tischler
+
+  libblake2 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  libblake2 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with libblake2; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#pragma once
+
+#include "Blake2b.hpp"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Blake2 {
+
+using std::array;
+using std::string;
+using std::vector;
+
+// A framing format for authenticated range reads. The data is cut into
+// chunks of a fixed size, every chunk gets a keyed tag bound to its index,
+// the chunk size, the data length and the container's random nonce, and a
+// root tag covers all chunk tags.
+//
+// A container is the header, the root tag, the table of chunk tags and the
+// data. The data starts at a known offset, so a reader can fetch the header,
+// the tags of the chunks a byte range touches and those chunks, and verify
+// just them.
+//
+// All tags are keyed BLAKE2b-512 with the given key, salt and
+// personalization. Without the key tags can't be forged, and since a tag
+// binds the index, the layout and the nonce, chunks can't be moved, dropped
+// or spliced in from another container.
+class BLAKE2_EXPORT_SYMBOL ChunkedContainer {
+    public:
+	using tag_t = Blake2b::hash_t;
+	using salt_t = Blake2b::salt_t;
+	using personalization_t = Blake2b::personalization_t;
+	using nonce_t = array<uint64_t, 2>;
+
+	static constexpr size_t header_size = 48;
+	static constexpr size_t tag_size = 64;
+	static constexpr size_t default_chunk_size = 64 * 1024;
+
+	struct Header {
+		uint32_t chunk_size;
+		uint64_t data_length;
+		nonce_t nonce;
+
+		uint64_t chunk_count() const;
+		// offsets into the container
+		uint64_t root_offset() const;
+		uint64_t tag_offset(const uint64_t &chunk) const;
+		uint64_t chunk_offset(const uint64_t &chunk) const;
+		uint64_t chunk_length(const uint64_t &chunk) const;
+		uint64_t container_length() const;
+	};
+
+	ChunkedContainer(const string &key,
+			 const salt_t &salt = salt_t{},
+			 const personalization_t &personalization = personalization_t{},
+			 const uint32_t &chunk_size = default_chunk_size);
+
+	// frames data under a fresh random nonce, the chunks are tagged in
+	// parallel
+	string encode(const char *data, const size_t &len) const;
+	string encode(const string &data) const;
+	// with a given nonce, for reproducible output. A nonce must not be
+	// used for two containers under the same key
+	string encode(const char *data, const size_t &len, const nonce_t &nonce) const;
+
+	// checks all tags in parallel and returns the data, throws
+	// invalid_argument if the container is malformed or was modified
+	string decode(const string &container) const;
+	bool verify(const string &container) const;
+
+	// returns the data bytes [offset, offset + len), only the chunks they
+	// touch are verified
+	string read_range(const string &container, const uint64_t &offset, const size_t &len) const;
+
+	// building blocks for readers that fetch parts of a container
+	static Header parse_header(const char *data, const size_t &len);
+	tag_t chunk_tag(const Header &header, const uint64_t &chunk, const char *data, const size_t &len) const;
+	tag_t root_tag(const Header &header, const vector<tag_t> &tags) const;
+	bool verify_chunk(const Header &header, const uint64_t &chunk, const char *data, const size_t &len, const char *tag) const;
+
+    private:
+	static nonce_t random_nonce();
+	vector<tag_t> chunk_tags(const Header &header, const char *data) const;
+
+	Blake2b b;
+	uint32_t chunk_size;
+};
+
+} // namespace Blake2
@@ -0,0 +1,310 @@
+/***
+  This file is part of libblake2
+
+  Copyright 2015 Mirco Tischler
+
+  libblake2 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  libblake2 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with libblake2; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#include "Filters.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Blake2 {
+
+using std::array;
+using std::invalid_argument;
+using std::max;
+using std::min;
+using std::string;
+using std::vector;
+
+// typedefs
+using indices_t = FilterHash::indices_t;
+
+// declaration of static data members
+constexpr size_t CacheLines::words_per_line;
+constexpr unsigned int BloomFilter::max_hashes;
+constexpr size_t CuckooFilter::bucket_size;
+constexpr unsigned int CuckooFilter::max_kicks;
+
+// number of keys hashed ahead so their cache lines are loaded in parallel
+static const size_t prefetch_batch = 16;
+static const size_t cache_line_size = CacheLines::words_per_line * sizeof(uint64_t);
+static const size_t buckets_per_line = CacheLines::words_per_line;
+
+//
+// implementations
+//
+
+FilterHash::FilterHash(const string &key) {
+	if (key.empty())
+		throw invalid_argument("a key is required");
+	b.set_key(key.data(), key.size());
+}
+
+CacheLines::CacheLines(const size_t &lines) :
+	storage(lines * words_per_line + words_per_line - 1, 0),
+	lines(lines) {
+	// a vector only guarantees word alignment, skip ahead to a line
+	auto address = reinterpret_cast<uintptr_t> (storage.data());
+	offset = ((cache_line_size - address % cache_line_size) % cache_line_size) / sizeof(uint64_t);
+}
+
+BloomFilter::BloomFilter(const size_t &bits, const unsigned int &hashes, const string &key) :
+	hash(key),
+	lines(max<size_t>(1, (bits + 511) / 512)),
+	hashes(hashes) {
+	if (hashes < 1 || hashes > max_hashes)
+		throw invalid_argument("invalid number of hashes");
+}
+
+void BloomFilter::insert(const string &item) {
+	insert(hash(item));
+}
+
+bool BloomFilter::contains(const string &item) const {
+	return contains(hash(item));
+}
+
+void BloomFilter::insert(const vector<string> &items) {
+	auto h = array<indices_t, prefetch_batch>();
+	for (auto i = size_t{0}; i < items.size(); i += prefetch_batch) {
+		auto n = min(prefetch_batch, items.size() - i);
+		for (auto j = size_t{0}; j < n; ++j) {
+			h[j] = hash(items[i + j]);
+			__builtin_prefetch(lines.line(line_index(h[j])), 1);
+		}
+		for (auto j = size_t{0}; j < n; ++j)
+			insert(h[j]);
+	}
+}
+
+vector<bool> BloomFilter::contains(const vector<string> &items) const {
+	auto result = vector<bool>(items.size());
+	auto h = array<indices_t, prefetch_batch>();
+	for (auto i = size_t{0}; i < items.size(); i += prefetch_batch) {
+		auto n = min(prefetch_batch, items.size() - i);
+		for (auto j = size_t{0}; j < n; ++j) {
+			h[j] = hash(items[i + j]);
+			__builtin_prefetch(lines.line(line_index(h[j])), 0);
+		}
+		for (auto j = size_t{0}; j < n; ++j)
+			result[i + j] = contains(h[j]);
+	}
+	return result;
+}
+
+// word 0 selects the line, the following words are cut into 9 bit offsets
+// into the 512 bit line
+void BloomFilter::insert(const indices_t &h) {
+	auto line = lines.line(line_index(h));
+	for (auto i = 0u; i < hashes; ++i) {
+		auto bit = (h[1 + i / 7] >> (9 * (i % 7))) & 511;
+		line[bit >> 6] |= 1ULL << (bit & 63);
+	}
+}
+
+bool BloomFilter::contains(const indices_t &h) const {
+	auto line = lines.line(line_index(h));
+	for (auto i = 0u; i < hashes; ++i) {
+		auto bit = (h[1 + i / 7] >> (9 * (i % 7))) & 511;
+		if ((line[bit >> 6] & (1ULL << (bit & 63))) == 0)
+			return false;
+	}
+	return true;
+}
+
+size_t BloomFilter::line_index(const indices_t &h) const {
+	return static_cast<size_t> (h[0] % lines.size());
+}
+
+static size_t bucket_count(const size_t &capacity) {
+	auto wanted = max((capacity + CuckooFilter::bucket_size - 1) / CuckooFilter::bucket_size, buckets_per_line);
+	auto n = buckets_per_line;
+	while (n < wanted)
+		n <<= 1;
+	return n;
+}
+
+CuckooFilter::CuckooFilter(const size_t &capacity, const string &key) :
+	hash(key),
+	lines(bucket_count(capacity) / buckets_per_line),
+	buckets(bucket_count(capacity)),
+	victim{false, 0, 0} {
+	random_state = hash(string())[0] | 1;
+}
+
+bool CuckooFilter::insert(const string &item) {
+	return insert(candidates(hash(item)));
+}
+
+bool CuckooFilter::contains(const string &item) const {
+	return contains(candidates(hash(item)));
+}
+
+bool CuckooFilter::remove(const string &item) {
+	auto c = candidates(hash(item));
+
+	for (const auto &index : {c.first, c.second}) {
+		auto &word = bucket(index);
+		for (auto s = 0u; s < bucket_size; ++s) {
+			if (((word >> (16 * s)) & 0xffff) != c.fingerprint)
+				continue;
+
+			word &= ~(0xffffULL << (16 * s));
+
+			// there is room again for the victim
+			if (victim.used) {
+				auto v = victim;
+				victim.used = false;
+				insert(Candidates{v.bucket, alternate(v.bucket, v.fingerprint), v.fingerprint});
+			}
+			return true;
+		}
+	}
+
+	if (victim.used && victim.fingerprint == c.fingerprint &&
+	    (victim.bucket == c.first || victim.bucket == c.second)) {
+		victim.used = false;
+		return true;
+	}
+
+	return false;
+}
+
+vector<bool> CuckooFilter::insert(const vector<string> &items) {
+	auto result = vector<bool>(items.size());
+	auto c = array<Candidates, prefetch_batch>();
+	for (auto i = size_t{0}; i < items.size(); i += prefetch_batch) {
+		auto n = min(prefetch_batch, items.size() - i);
+		for (auto j = size_t{0}; j < n; ++j) {
+			c[j] = candidates(hash(items[i + j]));
+			prefetch(c[j]);
+		}
+		for (auto j = size_t{0}; j < n; ++j)
+			result[i + j] = insert(c[j]);
+	}
+	return result;
+}
+
+vector<bool> CuckooFilter::contains(const vector<string> &items) const {
+	auto result = vector<bool>(items.size());
+	auto c = array<Candidates, prefetch_batch>();
+	for (auto i = size_t{0}; i < items.size(); i += prefetch_batch) {
+		auto n = min(prefetch_batch, items.size() - i);
+		for (auto j = size_t{0}; j < n; ++j) {
+			c[j] = candidates(hash(items[i + j]));
+			prefetch(c[j]);
+		}
+		for (auto j = size_t{0}; j < n; ++j)
+			result[i + j] = contains(c[j]);
+	}
+	return result;
+}
+
+// word 0 selects the first bucket and word 1 the fingerprint. 0 marks an
+// empty slot so it is not a valid fingerprint
+CuckooFilter::Candidates CuckooFilter::candidates(const indices_t &h) const {
+	auto c = Candidates();
+	c.first = static_cast<size_t> (h[0] & (buckets - 1));
+	c.fingerprint = static_cast<uint16_t> (h[1]);
+	if (c.fingerprint == 0)
+		c.fingerprint = 1;
+	c.second = alternate(c.first, c.fingerprint);
+	return c;
+}
+
+// partial key cuckoo hashing: the alternate bucket only depends on the
+// bucket and the fingerprint, so it can be found for stored fingerprints
+size_t CuckooFilter::alternate(const size_t &bucket, const uint16_t &fingerprint) const {
+	return (bucket ^ static_cast<size_t> (fingerprint * 0x5bd1e995ULL)) & (buckets - 1);
+}
+
+uint64_t &CuckooFilter::bucket(const size_t &index) {
+	return lines.line(index / buckets_per_line)[index % buckets_per_line];
+}
+
+const uint64_t &CuckooFilter::bucket(const size_t &index) const {
+	return lines.line(index / buckets_per_line)[index % buckets_per_line];
+}
+
+bool CuckooFilter::place(const size_t &index, const uint16_t &fingerprint) {
+	auto &word = bucket(index);
+	for (auto s = 0u; s < bucket_size; ++s) {
+		if (((word >> (16 * s)) & 0xffff) == 0) {
+			word |= static_cast<uint64_t> (fingerprint) << (16 * s);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool CuckooFilter::insert(const Candidates &c) {
+	if (victim.used)
+		return false;
+	if (place(c.first, c.fingerprint) || place(c.second, c.fingerprint))
+		return true;
+
+	// kick a random fingerprint to its alternate bucket until one fits
+	auto index = (random() & 1) ? c.first : c.second;
+	auto fingerprint = c.fingerprint;
+	for (auto n = 0u; n < max_kicks; ++n) {
+		auto s = random() % bucket_size;
+		auto &word = bucket(index);
+		auto evicted = static_cast<uint16_t> (word >> (16 * s));
+		word = (word & ~(0xffffULL << (16 * s))) | (static_cast<uint64_t> (fingerprint) << (16 * s));
+		fingerprint = evicted;
+
+		index = alternate(index, fingerprint);
+		if (place(index, fingerprint))
+			return true;
+	}
+
+	victim = Victim{true, index, fingerprint};
+	return true;
+}
+
+bool CuckooFilter::contains(const Candidates &c) const {
+	for (const auto &index : {c.first, c.second}) {
+		auto word = bucket(index);
+		for (auto s = 0u; s < bucket_size; ++s) {
+			if (((word >> (16 * s)) & 0xffff) == c.fingerprint)
+				return true;
+		}
+	}
+
+	return victim.used && victim.fingerprint == c.fingerprint &&
+		(victim.bucket == c.first || victim.bucket == c.second);
+}
+
+void CuckooFilter::prefetch(const Candidates &c) const {
+	__builtin_prefetch(&bucket(c.first));
+	__builtin_prefetch(&bucket(c.second));
+}
+
+// xorshift64*, only used to pick eviction victims
+uint64_t CuckooFilter::random() {
+	random_state ^= random_state >> 12;
+	random_state ^= random_state << 25;
+	random_state ^= random_state >> 27;
+	return random_state * 0x2545f4914f6cdd1dULL;
+}
+
+} // namespace Blake2
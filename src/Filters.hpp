@@ -0,0 +1,163 @@
+/***
+  This file is part of libblake2
+
+  Copyright 2015 Mirco Tischler
+
+  libblake2 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  libblake2 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with libblake2; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#pragma once
+
+#include "Blake2b.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Blake2 {
+
+using std::string;
+using std::vector;
+
+// Derives all indices a filter needs for one key from a single keyed
+// BLAKE2b hash: the 512 bit digest is used as 8 independent 64 bit words.
+// Keys of up to 128 bytes cost a single compression.
+class BLAKE2_EXPORT_SYMBOL FilterHash {
+    public:
+	using indices_t = Blake2b::hash_t;
+
+	// key is the secret that keeps an attacker from choosing colliding keys,
+	// an empty key throws invalid_argument
+	explicit FilterHash(const string &key);
+
+	indices_t operator()(const char *data, const size_t &len) const {
+		return b.hash(data, len);
+	}
+
+	indices_t operator()(const string &data) const {
+		return (*this)(data.data(), data.size());
+	}
+
+    private:
+	Blake2b b;
+};
+
+// Storage for the filters, aligned to cache lines so a line is one cache
+// miss.
+class BLAKE2_EXPORT_SYMBOL CacheLines {
+    public:
+	static constexpr size_t words_per_line = 8;
+
+	explicit CacheLines(const size_t &lines);
+
+	// a copy would lose the alignment
+	CacheLines(const CacheLines&) = delete;
+	CacheLines(CacheLines &&) = default;
+	CacheLines& operator=(const CacheLines&) = delete;
+	CacheLines& operator=(CacheLines&&) = default;
+
+	uint64_t *line(const size_t &index) {
+		return storage.data() + offset + index * words_per_line;
+	}
+
+	const uint64_t *line(const size_t &index) const {
+		return storage.data() + offset + index * words_per_line;
+	}
+
+	size_t size() const {
+		return lines;
+	}
+
+    private:
+	vector<uint64_t> storage;
+	size_t offset;
+	size_t lines;
+};
+
+// A blocked Bloom filter: every key maps to a single 512 bit cache line and
+// sets hashes bits in it.
+class BLAKE2_EXPORT_SYMBOL BloomFilter {
+    public:
+	static constexpr unsigned int max_hashes = 16;
+
+	BloomFilter(const size_t &bits, const unsigned int &hashes, const string &key);
+
+	void insert(const string &item);
+	bool contains(const string &item) const;
+
+	// the cache lines of a batch are prefetched before they are touched
+	void insert(const vector<string> &items);
+	vector<bool> contains(const vector<string> &items) const;
+
+    private:
+	void insert(const FilterHash::indices_t &h);
+	bool contains(const FilterHash::indices_t &h) const;
+	size_t line_index(const FilterHash::indices_t &h) const;
+
+	FilterHash hash;
+	CacheLines lines;
+	unsigned int hashes;
+};
+
+// A cuckoo filter with buckets of four 16 bit fingerprints packed into a
+// word, eight buckets to a cache line. Supports removal of inserted items.
+class BLAKE2_EXPORT_SYMBOL CuckooFilter {
+    public:
+	static constexpr size_t bucket_size = 4;
+	static constexpr unsigned int max_kicks = 500;
+
+	// capacity is rounded up to a power of two number of buckets
+	CuckooFilter(const size_t &capacity, const string &key);
+
+	// false if the filter is too full to take the item
+	bool insert(const string &item);
+	bool contains(const string &item) const;
+	bool remove(const string &item);
+
+	vector<bool> insert(const vector<string> &items);
+	vector<bool> contains(const vector<string> &items) const;
+
+    private:
+	struct Candidates {
+		size_t first;
+		size_t second;
+		uint16_t fingerprint;
+	};
+
+	// a fingerprint that was kicked out and found no place, the filter
+	// is full while it is in use
+	struct Victim {
+		bool used;
+		size_t bucket;
+		uint16_t fingerprint;
+	};
+
+	Candidates candidates(const FilterHash::indices_t &h) const;
+	size_t alternate(const size_t &bucket, const uint16_t &fingerprint) const;
+	uint64_t &bucket(const size_t &index);
+	const uint64_t &bucket(const size_t &index) const;
+	bool place(const size_t &index, const uint16_t &fingerprint);
+	bool insert(const Candidates &c);
+	bool contains(const Candidates &c) const;
+	void prefetch(const Candidates &c) const;
+	uint64_t random();
+
+	FilterHash hash;
+	CacheLines lines;
+	size_t buckets;
+	Victim victim;
+	uint64_t random_state;
+};
+
+} // namespace Blake2
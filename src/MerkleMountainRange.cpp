@@ -0,0 +1,356 @@
+/***
+  This file is part of libblake2
+
+  Copyright 2015 Mirco Tischler
+
+  libblake2 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  libblake2 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with libblake2; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#include "MerkleMountainRange.hpp"
+#include "AsyncBlake2b.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <exception>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Blake2 {
+
+using std::array;
+using std::current_exception;
+using std::future;
+using std::make_shared;
+using std::max;
+using std::memcpy;
+using std::min;
+using std::out_of_range;
+using std::promise;
+using std::string;
+using std::thread;
+using std::vector;
+
+// typedefs
+using hash_t = MerkleMountainRange::hash_t;
+using InclusionProof = MerkleMountainRange::InclusionProof;
+using ConsistencyProof = MerkleMountainRange::ConsistencyProof;
+
+// local typedefs
+struct Mountain {
+	unsigned int height;
+	uint64_t start;
+};
+
+// every worker gets at least this many entries of a batch
+static const size_t parallel_batch = 64;
+
+// forward declarations of static methods
+static const Blake2b &leaf_hasher();
+static const Blake2b &node_hasher();
+static const Blake2b &root_hasher();
+static hash_t hash_node(const hash_t &left, const hash_t &right);
+static hash_t bag(const vector<hash_t> &peaks, const uint64_t &size);
+static vector<Mountain> mountains(const uint64_t &size);
+static Blake2b personalized(const char *personalization);
+
+//
+// implementations
+//
+
+void MerkleMountainRange::append(const char *entry, const size_t &len) {
+	append_leaf(leaf_hasher().hash(entry, len));
+}
+
+void MerkleMountainRange::append(const string &entry) {
+	append(entry.data(), entry.size());
+}
+
+void MerkleMountainRange::append(const vector<string> &entries) {
+	auto parts = min<size_t>(max(1u, thread::hardware_concurrency()), entries.size() / parallel_batch);
+	if (parts <= 1) {
+		for (const auto &e : entries)
+			append(e);
+		return;
+	}
+
+	// the leaves are independent of each other, only merging is sequential.
+	// every worker hashes a contiguous range so the per task overhead is
+	// paid once per range instead of once per entry
+	auto leaves = vector<hash_t>(entries.size());
+	auto executor = AsyncBlake2b::default_executor();
+	auto pending = vector<future<void>>();
+	for (auto part = size_t{0}; part < parts; ++part) {
+		auto first = entries.size() * part / parts;
+		auto last = entries.size() * (part + 1) / parts;
+		auto p = make_shared<promise<void>>();
+		pending.push_back(p->get_future());
+		executor([p, &entries, &leaves, first, last]() {
+			try {
+				for (auto i = first; i < last; ++i)
+					leaves[i] = leaf_hasher().hash(entries[i].data(), entries[i].size());
+				p->set_value();
+			} catch (...) {
+				p->set_exception(current_exception());
+			}
+		});
+	}
+	for (auto &f : pending)
+		f.get();
+
+	for (const auto &leaf : leaves)
+		append_leaf(leaf);
+}
+
+void MerkleMountainRange::append_leaf(const hash_t &leaf) {
+	auto index = leaves;
+	auto node = leaf;
+	auto k = 0u;
+
+	// every odd index completes a tree one level up
+	for (;;) {
+		if (levels.size() <= k)
+			levels.emplace_back();
+		levels[k].push_back(node);
+		if ((index & 1) == 0)
+			break;
+		node = hash_node(levels[k][index - 1], node);
+		index >>= 1;
+		++k;
+	}
+
+	++leaves;
+}
+
+hash_t MerkleMountainRange::root() const {
+	return bag(peaks(leaves), leaves);
+}
+
+vector<hash_t> MerkleMountainRange::peaks(const uint64_t &size) const {
+	assert(size <= leaves);
+
+	auto result = vector<hash_t>();
+	for (const auto &m : mountains(size))
+		result.push_back(levels[m.height][m.start >> m.height]);
+	return result;
+}
+
+InclusionProof MerkleMountainRange::prove_inclusion(const uint64_t &leaf_index) const {
+	if (leaf_index >= leaves)
+		throw out_of_range("leaf index out of range");
+
+	auto proof = InclusionProof();
+	proof.leaf_index = leaf_index;
+	proof.size = leaves;
+
+	for (const auto &m : mountains(leaves)) {
+		if (leaf_index >= m.start && leaf_index < m.start + (1ULL << m.height)) {
+			for (auto k = 0u; k < m.height; ++k)
+				proof.siblings.push_back(levels[k][(leaf_index >> k) ^ 1]);
+		} else {
+			proof.peaks.push_back(levels[m.height][m.start >> m.height]);
+		}
+	}
+
+	return proof;
+}
+
+ConsistencyProof MerkleMountainRange::prove_consistency(const uint64_t &old_size) const {
+	if (old_size < 1 || old_size > leaves)
+		throw out_of_range("old size out of range");
+
+	auto proof = ConsistencyProof();
+	proof.old_size = old_size;
+	proof.new_size = leaves;
+	proof.old_peaks = peaks(old_size);
+	proof.new_peaks = peaks(leaves);
+
+	// climb from the last old peak to the new peak above it, the left
+	// siblings on the way are old peaks themselves
+	auto last = mountains(old_size).back();
+	for (const auto &m : mountains(leaves)) {
+		if (old_size - 1 < m.start || old_size - 1 >= m.start + (1ULL << m.height))
+			continue;
+
+		auto j = last.start >> last.height;
+		for (auto k = last.height; k < m.height; ++k, j >>= 1) {
+			if ((j & 1) == 0)
+				proof.siblings.push_back(levels[k][j + 1]);
+		}
+	}
+
+	return proof;
+}
+
+bool MerkleMountainRange::verify_inclusion(const hash_t &root, const string &entry, const InclusionProof &proof) {
+	if (proof.leaf_index >= proof.size)
+		return false;
+
+	auto ms = mountains(proof.size);
+	if (proof.peaks.size() + 1 != ms.size())
+		return false;
+
+	auto peaks = vector<hash_t>();
+	auto other = proof.peaks.begin();
+	for (const auto &m : ms) {
+		if (proof.leaf_index < m.start || proof.leaf_index >= m.start + (1ULL << m.height)) {
+			peaks.push_back(*other);
+			++other;
+			continue;
+		}
+
+		if (proof.siblings.size() != m.height)
+			return false;
+
+		auto node = leaf_hasher().hash(entry.data(), entry.size());
+		for (auto k = 0u; k < m.height; ++k) {
+			if ((proof.leaf_index >> k) & 1)
+				node = hash_node(proof.siblings[k], node);
+			else
+				node = hash_node(node, proof.siblings[k]);
+		}
+		peaks.push_back(node);
+	}
+
+	return bag(peaks, proof.size) == root;
+}
+
+bool MerkleMountainRange::verify_consistency(const hash_t &old_root, const hash_t &new_root, const ConsistencyProof &proof) {
+	if (proof.old_size < 1 || proof.old_size > proof.new_size)
+		return false;
+
+	auto old_ms = mountains(proof.old_size);
+	auto new_ms = mountains(proof.new_size);
+	if (proof.old_peaks.size() != old_ms.size() || proof.new_peaks.size() != new_ms.size())
+		return false;
+	if (bag(proof.old_peaks, proof.old_size) != old_root || bag(proof.new_peaks, proof.new_size) != new_root)
+		return false;
+
+	auto old_size = proof.old_size;
+	for (auto i = 0u; i < new_ms.size(); ++i) {
+		const auto &m = new_ms[i];
+		auto end = m.start + (1ULL << m.height);
+		if (m.start >= old_size)
+			break;
+
+		// the old peaks covered by this mountain, they are a suffix of
+		// the old peaks unless the mountain is an old mountain itself
+		auto first = 0u;
+		while (first < old_ms.size() && old_ms[first].start < m.start)
+			++first;
+		if (first == old_ms.size() || old_ms[first].start != m.start)
+			return false;
+
+		if (end <= old_size) {
+			if (old_ms[first].height != m.height || proof.old_peaks[first] != proof.new_peaks[i])
+				return false;
+			continue;
+		}
+
+		auto r = old_ms.size() - 1;
+		auto node = proof.old_peaks[r];
+		auto j = old_ms[r].start >> old_ms[r].height;
+		auto sibling = proof.siblings.begin();
+		for (auto k = old_ms[r].height; k < m.height; ++k, j >>= 1) {
+			if (j & 1) {
+				if (r == first)
+					return false;
+				--r;
+				if (old_ms[r].height != k || old_ms[r].start >> k != j - 1)
+					return false;
+				node = hash_node(proof.old_peaks[r], node);
+			} else {
+				if (sibling == proof.siblings.end())
+					return false;
+				node = hash_node(node, *sibling);
+				++sibling;
+			}
+		}
+
+		if (r != first || sibling != proof.siblings.end())
+			return false;
+		return node == proof.new_peaks[i];
+	}
+
+	// the old log ends on a mountain boundary
+	return proof.siblings.empty();
+}
+
+static const Blake2b &leaf_hasher() {
+	static const auto b = personalized("libblake2 mmr lf");
+	return b;
+}
+
+static const Blake2b &node_hasher() {
+	static const auto b = personalized("libblake2 mmr nd");
+	return b;
+}
+
+static const Blake2b &root_hasher() {
+	static const auto b = personalized("libblake2 mmr rt");
+	return b;
+}
+
+static Blake2b personalized(const char *personalization) {
+	auto p = Blake2b::personalization_t();
+	memcpy(p.data(), personalization, sizeof(p));
+
+	auto b = Blake2b();
+	b.set_personalization(p);
+	return b;
+}
+
+static hash_t hash_node(const hash_t &left, const hash_t &right) {
+	// both children fit a single block
+	auto block = Blake2b::block_t();
+	memcpy(block.data(), left.data(), sizeof(left));
+	memcpy(block.data() + 8, right.data(), sizeof(right));
+	return node_hasher().hash_short(reinterpret_cast<const char *> (block.data()), sizeof(block));
+}
+
+static hash_t bag(const vector<hash_t> &peaks, const uint64_t &size) {
+	// fold the peaks right to left and bind the result to the size so
+	// logs of different length can't share a root
+	auto bagged = hash_t();
+	bagged.fill(0);
+	if (!peaks.empty()) {
+		bagged = peaks.back();
+		for (auto it = peaks.rbegin() + 1; it != peaks.rend(); ++it)
+			bagged = hash_node(*it, bagged);
+	}
+
+	auto block = array<uint64_t, 9>();
+	block[0] = size;
+	memcpy(block.data() + 1, bagged.data(), sizeof(bagged));
+	return root_hasher().hash_short(reinterpret_cast<const char *> (block.data()), sizeof(block));
+}
+
+// the mountains of a log of the given size, highest first
+static vector<Mountain> mountains(const uint64_t &size) {
+	auto result = vector<Mountain>();
+	auto start = uint64_t{0};
+	for (auto h = 63; h >= 0; --h) {
+		if ((size >> h) & 1) {
+			result.push_back(Mountain{static_cast<unsigned int> (h), start});
+			start += 1ULL << h;
+		}
+	}
+	return result;
+}
+
+} // namespace Blake2
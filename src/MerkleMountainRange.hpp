@@ -0,0 +1,94 @@
+/***
+  This file is part of libblake2
+
+  Copyright 2015 Mirco Tischler
+
+  libblake2 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  libblake2 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with libblake2; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#pragma once
+
+#include "Blake2b.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Blake2 {
+
+using std::string;
+using std::vector;
+
+// An append-only accumulator over a log of entries. Entries are the leaves of
+// a list of perfect binary trees (mountains) whose sizes are the binary
+// decomposition of the number of entries. An append costs one leaf hash and
+// on average one node hash, the root is the size bound hash of the mountain
+// peaks.
+//
+// Leaves, inner nodes and the root are hashed with different
+// personalizations, an inner node is a single compression.
+class BLAKE2_EXPORT_SYMBOL MerkleMountainRange {
+    public:
+	using hash_t = Blake2b::hash_t;
+
+	struct InclusionProof {
+		uint64_t leaf_index;
+		uint64_t size;
+		// from the leaf up to the peak of its mountain
+		vector<hash_t> siblings;
+		// the peaks of all other mountains, left to right
+		vector<hash_t> peaks;
+	};
+
+	struct ConsistencyProof {
+		uint64_t old_size;
+		uint64_t new_size;
+		vector<hash_t> old_peaks;
+		// the right siblings needed to grow the last old peaks into the
+		// new peak covering them, bottom up
+		vector<hash_t> siblings;
+		vector<hash_t> new_peaks;
+	};
+
+	MerkleMountainRange() : leaves(0) { }
+
+	void append(const char *entry, const size_t &len);
+	void append(const string &entry);
+	// the leaves of large batches are hashed in parallel
+	void append(const vector<string> &entries);
+
+	uint64_t size() const {
+		return leaves;
+	}
+
+	hash_t root() const;
+
+	InclusionProof prove_inclusion(const uint64_t &leaf_index) const;
+	// proves that the log of old_size entries is a prefix of this log
+	ConsistencyProof prove_consistency(const uint64_t &old_size) const;
+
+	static bool verify_inclusion(const hash_t &root, const string &entry, const InclusionProof &proof);
+	static bool verify_consistency(const hash_t &old_root, const hash_t &new_root, const ConsistencyProof &proof);
+
+    private:
+	void append_leaf(const hash_t &leaf);
+	vector<hash_t> peaks(const uint64_t &size) const;
+
+	// levels[k][j] is the root of the perfect tree over the leaves
+	// j * 2^k to (j + 1) * 2^k - 1, stored once the tree is complete
+	vector<vector<hash_t>> levels;
+	uint64_t leaves;
+};
+
+} // namespace Blake2
@@ -17,15 +17,26 @@
   along with libblake2; If not, see <http://www.gnu.org/licenses/>.
  ***/
 
+#include "Argon2.hpp"
 #include "Blake2b.hpp"
 #include "blake2b.h"
+#include "blake2bd-protocol.h"
 
 #include <array>
+#include <cerrno>
+#include <cstdlib>
 #include <exception>
 #include <iostream>
 #include <iomanip>
 #include <string>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
 using std::array;
 using std::exception;
 using std::string;
@@ -36,6 +47,127 @@ struct Blake2b {
 	Blake2::Blake2b b;
 };
 
+} // extern "C"
+
+// a sealed memfd holding the payload, so the daemon can map it without the
+// payload being copied through the socket
+static int payload_memfd(const char *message, const size_t &len) {
+	auto fd = memfd_create("blake2b", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0)
+		return -1;
+
+	auto written = size_t{0};
+	while (written < len) {
+		auto n = write(fd, message + written, len - written);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			close(fd);
+			return -1;
+		}
+		written += n;
+	}
+
+	if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// the data only goes to a daemon run by root or by ourselves
+static bool trusted_peer(const int &fd) {
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0 || len != sizeof(cred))
+		return false;
+	return cred.uid == 0 || cred.uid == getuid();
+}
+
+// hash message with the parameters of b in blake2bd, -1 if that failed for
+// whatever reason
+static int daemon_hash(const Blake2::Blake2b &b, const char *message, const size_t &len, uint8_t *hash) {
+	auto path = getenv("BLAKE2BD_SOCKET");
+	if (!path)
+		path = const_cast<char *> (BLAKE2BD_SOCKET_PATH);
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -1;
+	strcpy(addr.sun_path, path);
+
+	// the daemon starts from a fresh state with our parameters
+	auto fresh = b;
+	fresh.reset();
+	auto state = fresh.export_state();
+
+	struct blake2bd_request request;
+	memset(&request, 0, sizeof(request));
+	request.magic = BLAKE2BD_MAGIC;
+	request.version = BLAKE2BD_VERSION;
+	request.length = len;
+	request.inline_payload = len <= BLAKE2BD_INLINE_MAX;
+	memcpy(request.state, state.data(), state.size());
+
+	struct iovec iov[2] = {
+		{&request, sizeof(request)},
+		{const_cast<char *> (message), len}
+	};
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = request.inline_payload ? 2 : 1;
+
+	union {
+		struct cmsghdr header;
+		char data[CMSG_SPACE(sizeof(int))];
+	} control;
+	auto memfd = -1;
+	if (!request.inline_payload) {
+		memfd = payload_memfd(message, len);
+		if (memfd < 0)
+			return -1;
+		memset(&control, 0, sizeof(control));
+		msg.msg_control = &control;
+		msg.msg_controllen = sizeof(control);
+		auto cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &memfd, sizeof(int));
+	}
+
+	// a hung daemon must not hang the caller, give up and hash in process
+	struct timeval timeout;
+	timeout.tv_sec = BLAKE2BD_TIMEOUT_SECONDS * (1 + len / BLAKE2BD_TIMEOUT_BYTES);
+	timeout.tv_usec = 0;
+
+	auto result = -1;
+	auto fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (fd >= 0 &&
+	    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) == 0 &&
+	    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == 0 &&
+	    connect(fd, reinterpret_cast<struct sockaddr *> (&addr), sizeof(addr)) == 0 &&
+	    trusted_peer(fd) &&
+	    sendmsg(fd, &msg, MSG_NOSIGNAL) == static_cast<ssize_t> (sizeof(request) + (request.inline_payload ? len : 0))) {
+		struct blake2bd_response response;
+		if (recv(fd, &response, sizeof(response), 0) == sizeof(response) && response.status == 0) {
+			memcpy(hash, response.hash, sizeof(response.hash));
+			result = 0;
+		}
+	}
+
+	if (fd >= 0)
+		close(fd);
+	if (memfd >= 0)
+		close(memfd);
+	return result;
+}
+
+extern "C" {
+
 blake2b *blake2b_new() {
 	return new blake2b;
 }
@@ -44,6 +176,18 @@ void blake2b_delete(blake2b* b) {
 	delete b;
 }
 
+blake2b *blake2b_clone(const blake2b *b) {
+	assert(b);
+	return new blake2b(*b);
+}
+
+int blake2b_copy_state(blake2b *dst, const blake2b *src) {
+	assert(dst);
+	assert(src);
+	dst->b = src->b;
+	return 0;
+}
+
 int blake2b_set_digest_length(blake2b *b, const size_t digest_len) {
 	try {
 		b->b.set_digest_length(digest_len);
@@ -53,7 +197,14 @@ int blake2b_set_digest_length(blake2b *b, const size_t digest_len) {
 	return 0;
 }
 
-//int blake2b_set_key(blake2b *b, const char *const key, const size_t key_len);
+int blake2b_set_key(blake2b *b, const char *const key, const size_t key_len) {
+	try {
+		b->b.set_key(key, key_len);
+	} catch (exception &e) {
+		return -1;
+	}
+	return 0;
+}
 
 int blake2b_set_salt(blake2b *b, const char *const salt, const size_t salt_len) {
 	try {
@@ -92,6 +243,121 @@ int blake2b_hash(blake2b *b, const char *const message, const size_t len, uint8_
 	}
 }
 
+int blake2b_reset(blake2b *b) {
+	assert(b);
+	try {
+		b->b.reset();
+	} catch (exception &e) {
+		return -1;
+	}
+	return 0;
+}
+
+int blake2b_update(blake2b *b, const char *const data, const size_t len) {
+	assert(b);
+	assert(data || len == 0);
+	try {
+		b->b.update(data, len);
+	} catch (exception &e) {
+		return -1;
+	}
+	return 0;
+}
+
+int blake2b_final(blake2b *b, uint8_t * const hash) {
+	assert(b);
+	assert(hash);
+	try {
+		Blake2::Blake2b::hash_t h = b->b.final();
+		memcpy(hash, h.data(), 64 * sizeof(uint8_t));
+		return 0;
+	} catch (exception &e) {
+		return -1;
+	}
+}
+
+int blake2b_hash_daemon(blake2b *b, const char *const message, const size_t len, uint8_t * const hash) {
+	assert(b);
+	assert(message || len == 0);
+	assert(hash);
+	try {
+		// keys never leave the process
+		if (!b->b.is_keyed() && daemon_hash(b->b, message, len, hash) == 0)
+			return 0;
+
+		// keyed or no daemon, hash in process
+		Blake2::Blake2b::hash_t h = b->b(message, len);
+		memcpy(hash, h.data(), 64 * sizeof(uint8_t));
+		return 0;
+	} catch (exception &e) {
+		return -1;
+	}
+}
+
+int blake2b_final_suffix(const blake2b *b, const char * const suffix, const size_t len, uint8_t * const hash) {
+	assert(b);
+	assert(suffix || len == 0);
+	assert(hash);
+	try {
+		Blake2::Blake2b::hash_t h = b->b.final(suffix, len);
+		memcpy(hash, h.data(), 64 * sizeof(uint8_t));
+		return 0;
+	} catch (exception &e) {
+		return -1;
+	}
+}
+
+static_assert(BLAKE2B_STATE_SIZE == Blake2::Blake2b::state_size, "state size mismatch");
+
+int blake2b_export_state(const blake2b *b, uint8_t * const state, const size_t state_len) {
+	assert(b);
+	assert(state);
+	if (state_len < BLAKE2B_STATE_SIZE)
+		return -1;
+	try {
+		auto blob = b->b.export_state();
+		memcpy(state, blob.data(), blob.size());
+		return 0;
+	} catch (exception &e) {
+		return -1;
+	}
+}
+
+int blake2b_import_state(blake2b *b, const uint8_t * const state, const size_t state_len) {
+	assert(b);
+	assert(state);
+	try {
+		b->b.import_state(state, state_len);
+		return 0;
+	} catch (exception &e) {
+		return -1;
+	}
+}
+
+int blake2b_argon2id(const uint32_t t_cost, const uint32_t m_cost, const uint32_t parallelism,
+		     const char *const password, const size_t password_len,
+		     const char *const salt, const size_t salt_len,
+		     const char *const secret, const size_t secret_len,
+		     const char *const ad, const size_t ad_len,
+		     uint8_t *const tag, const size_t tag_len) {
+	assert(password || password_len == 0);
+	assert(salt);
+	assert(secret || secret_len == 0);
+	assert(ad || ad_len == 0);
+	assert(tag);
+	try {
+		Blake2::Argon2id a(t_cost, m_cost, parallelism, tag_len);
+		auto t = a(string(password, password_len),
+			   string(salt, salt_len),
+			   string(secret ? secret : "", secret_len),
+			   string(ad ? ad : "", ad_len));
+		memcpy(tag, t.data(), t.size());
+		return 0;
+	} catch (exception &e) {
+		return -1;
+	}
+}
+
 int blake2b_hash_to_hex(const uint8_t * const hash, const size_t hlen, char *const output) {
 	assert(hash);
 	assert(output);
@@ -17,19 +17,707 @@
   along with libblake2; If not, see <http://www.gnu.org/licenses/>.
  ***/
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
 
 #include <blake2b.h>
 
+#include "digest-cache.h"
+
+/* files larger than this are mapped in windows of this size so memory use
+ * stays flat no matter how large the file is */
+#define DEFAULT_WINDOW_SIZE (64 * 1024 * 1024)
+
+/* windows at least this large are worth backing with huge pages */
+#define HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+/* holes are hashed from a static block of zeros of this size */
+#define ZERO_BLOCK_SIZE (64 * 1024)
+
+/* the default pipe capacity, the most a single tee() can move */
+#define PIPE_CHUNK_SIZE (64 * 1024)
+
+/* the hash parameters digests in the cache depend on, the digest length */
+#define CACHE_PARAMS 64
+
+/* --find-duplicates hashes this much of every file of a shared size first.
+ * Files no larger than this are hashed completely in that stage. */
+#define PREFIX_SIZE 4096
+
+/* the truncated digest length used for prefixes */
+#define PREFIX_DIGEST_LENGTH 16
+
+/* a file considered by --find-duplicates */
+struct candidate {
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    int failed;
+    /* the prefix digest, the full digest for files up to PREFIX_SIZE */
+    uint8_t prefix[64];
+    uint8_t hash[64];
+};
+
+/* one stage of --find-duplicates, the candidates are spread over threads */
+struct stage {
+    pthread_mutex_t lock;
+    struct candidate *candidates;
+    size_t count;
+    size_t next;
+    size_t window;
+    int full;
+};
+
+/* the files collected by nftw(), which has no argument for the callback */
+static struct candidate *found;
+static size_t found_count;
+static size_t found_capacity;
+static int found_errors;
+
+static void usage(const char *name) {
+    printf("Usage: %s [OPTION]... FILE...\n"
+           "Print BLAKE2b (512-bit) checksums.\n\n"
+           "  -w, --window=BYTES       map large files in windows of BYTES (default %d)\n"
+           "  -t, --tee                copy FILE or standard input to standard output\n"
+           "                           while hashing it, the checksum goes to stderr\n"
+           "  -d, --digest-file=FILE   with --tee write the checksum to FILE instead\n"
+           "  -c, --cache=FILE         reuse checksums of unchanged files stored in FILE\n"
+           "  -f, --rehash             with --cache hash all files and refresh the cache\n"
+           "  -D, --find-duplicates    print groups of identical files found in FILEs\n"
+           "                           and below directories among them, hard links\n"
+           "                           to a file are listed once\n"
+           "  -j, --threads=N          with --find-duplicates read N files at once\n"
+           "                           (default: number of CPUs)\n"
+           "  -h, --help               display this help and exit\n",
+           name, DEFAULT_WINDOW_SIZE);
+}
+
+static int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Forward a window of the input file to out. sendfile() copies inside the
+ * kernel and works for pipes and sockets, fall back to writing from the
+ * mapping otherwise. */
+static int forward_window(int out, int fd, const char *data, off_t offset, size_t len) {
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t n = sendfile(out, fd, &offset, len - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EINVAL || errno == ENOSYS) && done == 0)
+            return write_all(out, data, len);
+        if (n <= 0)
+            return -1;
+        done += n;
+    }
+    return 0;
+}
+
+static void advise(void *addr, size_t len) {
+    madvise(addr, len, MADV_SEQUENTIAL);
+    madvise(addr, len, MADV_WILLNEED);
+#ifdef MADV_HUGEPAGE
+    if (len >= HUGEPAGE_SIZE)
+        madvise(addr, len, MADV_HUGEPAGE);
+#endif
+}
+
+/* Hash len zero bytes, and forward them to out if it is valid, without
+ * reading anything. */
+static int hash_zeros(blake2b *b, off_t len, int out) {
+    static const char zeros[ZERO_BLOCK_SIZE];
+
+    while (len > 0) {
+        size_t n = len < (off_t) sizeof(zeros) ? (size_t) len : sizeof(zeros);
+
+        if (blake2b_update(b, zeros, n) != 0)
+            return -1;
+        if (out >= 0 && write_all(out, zeros, n) != 0)
+            return -1;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Map the range [start, end) of the file one window at a time and drop each
+ * window once it has been hashed. The kernel is asked to read ahead the
+ * next window while the current one is hashed. If out is a valid file
+ * descriptor every window is forwarded to it as well. */
+static int hash_range(blake2b *b, int fd, off_t start, off_t end, size_t window, int out) {
+    static long page_size = 0;
+    off_t offset;
+    int r;
+
+    if (!page_size)
+        page_size = sysconf(_SC_PAGESIZE);
+
+    for (offset = start; offset < end; offset += window) {
+        /* mmap offsets have to be page aligned, extents need not be */
+        size_t skip = offset % page_size;
+        size_t len = window;
+        char *map;
+
+        if ((off_t) len > end - offset)
+            len = end - offset;
+
+        map = mmap(NULL, skip + len, PROT_READ, MAP_SHARED, fd, offset - skip);
+        if (map == MAP_FAILED)
+            return -1;
+
+        advise(map, skip + len);
+        if (offset + (off_t) len < end)
+            posix_fadvise(fd, offset + len, window, POSIX_FADV_WILLNEED);
+
+        r = blake2b_update(b, map + skip, len);
+        if (r == 0 && out >= 0)
+            r = forward_window(out, fd, map + skip, offset, len);
+
+        madvise(map, skip + len, MADV_DONTNEED);
+        munmap(map, skip + len);
+
+        if (r != 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+/* Hash a file of the given size. Holes found with SEEK_DATA and SEEK_HOLE
+ * are hashed from a static zero block, so they cost no reads and no page
+ * faults, only the data extents are mapped. Filesystems without hole
+ * support report the whole file as data. */
+static int hash_fd(blake2b *b, int fd, off_t size, size_t window, int out, uint8_t *hash) {
+    off_t offset = 0;
+    int sparse = 1;
+    int r;
+
+    r = blake2b_reset(b);
+    if (r != 0)
+        return -1;
+
+    while (offset < size) {
+        off_t data = offset, hole = size;
+
+        if (sparse) {
+            data = lseek(fd, offset, SEEK_DATA);
+            if (data < 0 && errno == ENXIO) {
+                /* only a hole is left */
+                data = size;
+            } else if (data < 0) {
+                sparse = 0;
+                data = offset;
+            } else {
+                hole = lseek(fd, data, SEEK_HOLE);
+                if (hole < 0)
+                    hole = size;
+            }
+
+            /* the file may have changed size since it was stat()ed */
+            if (data > size)
+                data = size;
+            if (hole > size)
+                hole = size;
+        }
+
+        if (hash_zeros(b, data - offset, out) != 0 ||
+            hash_range(b, fd, data, hole, window, out) != 0)
+            return -1;
+        offset = hole;
+    }
+
+    return blake2b_final(b, hash);
+}
+
+/* Copy a stream to out while hashing it. If both ends are pipes tee()
+ * duplicates the data into out without a copy through user space and only
+ * the copy needed for hashing is read. Otherwise read and write. */
+static int tee_stream(blake2b *b, int in, int out, uint8_t *hash) {
+    static char buf[PIPE_CHUNK_SIZE];
+    int use_tee = 1;
+    int r;
+
+    r = blake2b_reset(b);
+    if (r != 0)
+        return -1;
+
+    for (;;) {
+        ssize_t n, done;
+
+        if (use_tee) {
+            n = tee(in, out, sizeof(buf), 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0 && errno == EINVAL) {
+                use_tee = 0;
+                continue;
+            }
+            if (n < 0)
+                return -1;
+            if (n == 0)
+                break;
+
+            /* consume exactly what has been duplicated */
+            for (done = 0; done < n;) {
+                ssize_t m = read(in, buf + done, n - done);
+                if (m < 0 && errno == EINTR)
+                    continue;
+                if (m <= 0)
+                    return -1;
+                done += m;
+            }
+        } else {
+            n = read(in, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                return -1;
+            if (n == 0)
+                break;
+            if (write_all(out, buf, n) != 0)
+                return -1;
+        }
+
+        r = blake2b_update(b, buf, n);
+        if (r != 0)
+            return -1;
+    }
+
+    return blake2b_final(b, hash);
+}
+
+static int print_hash(const uint8_t *hash, const char *name) {
+    char hex[129];
+    int r;
+
+    r = blake2b_hash_to_hex(hash, 64, hex);
+    if (r != 0) {
+        printf("Could not convert to hex: %s\n", name);
+        return -1;
+    }
+
+    printf("%s  %s\n", hex, name);
+    return 0;
+}
+
+/* hash FILE or standard input while copying it to standard output */
+static int tee_main(blake2b *b, const char *path, size_t window, const char *digest_file) {
+    const char *name = path ? path : "-";
+    uint8_t hash[64];
+    char hex[129];
+    struct stat s;
+    FILE *f;
+    int fd = STDIN_FILENO;
+    int r;
+
+    if (path) {
+        fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            fprintf(stderr, "Could not open file %s: %s\n", path, strerror(errno));
+            return 1;
+        }
+    }
+
+    r = fstat(fd, &s);
+    if (r == 0 && S_ISREG(s.st_mode))
+        r = hash_fd(b, fd, s.st_size, window, STDOUT_FILENO, hash);
+    else if (r == 0)
+        r = tee_stream(b, fd, STDOUT_FILENO, hash);
+    if (path)
+        close(fd);
+    if (r != 0) {
+        fprintf(stderr, "Could not hash %s: %s\n", name, strerror(errno));
+        return 1;
+    }
+
+    r = blake2b_hash_to_hex(hash, 64, hex);
+    if (r != 0) {
+        fprintf(stderr, "Could not convert to hex: %s\n", name);
+        return 1;
+    }
+
+    f = digest_file ? fopen(digest_file, "w") : stderr;
+    if (!f) {
+        fprintf(stderr, "Could not open digest file %s: %s\n", digest_file, strerror(errno));
+        return 1;
+    }
+    fprintf(f, "%s  %s\n", hex, name);
+    if (digest_file && fclose(f) != 0) {
+        fprintf(stderr, "Could not write digest file %s: %s\n", digest_file, strerror(errno));
+        return 1;
+    }
+
+    return 0;
+}
+
+static int collect(const char *path, const struct stat *s, int type, struct FTW *ftw) {
+    (void) ftw;
+
+    if (type == FTW_DNR || type == FTW_NS) {
+        fprintf(stderr, "Could not read %s\n", path);
+        found_errors = 1;
+        return 0;
+    }
+    if (type != FTW_F || !S_ISREG(s->st_mode))
+        return 0;
+
+    if (found_count == found_capacity) {
+        size_t capacity = found_capacity ? found_capacity * 2 : 1024;
+        struct candidate *c = realloc(found, capacity * sizeof(*c));
+        if (!c)
+            return -1;
+        found = c;
+        found_capacity = capacity;
+    }
+
+    memset(&found[found_count], 0, sizeof(found[found_count]));
+    found[found_count].path = strdup(path);
+    if (!found[found_count].path)
+        return -1;
+    found[found_count].dev = s->st_dev;
+    found[found_count].ino = s->st_ino;
+    found[found_count].size = s->st_size;
+    ++found_count;
+    return 0;
+}
+
+static int compare_inode(const void *a, const void *b) {
+    const struct candidate *x = a, *y = b;
+
+    if (x->dev != y->dev)
+        return x->dev < y->dev ? -1 : 1;
+    if (x->ino != y->ino)
+        return x->ino < y->ino ? -1 : 1;
+    return strcmp(x->path, y->path);
+}
+
+/* A file reached by several paths, because it was named twice or has hard
+ * links, is not a duplicate of itself. Keep only its first path so it is
+ * never reported as a copy that could be deleted, returns the new count. */
+static size_t drop_same_files(struct candidate *c, size_t count) {
+    size_t i, kept = 0;
+
+    qsort(c, count, sizeof(*c), compare_inode);
+
+    for (i = 0; i < count; ++i) {
+        if (kept > 0 && c[kept - 1].dev == c[i].dev && c[kept - 1].ino == c[i].ino)
+            free(c[i].path);
+        else
+            c[kept++] = c[i];
+    }
+    return kept;
+}
+
+static int compare_size(const void *a, const void *b) {
+    const struct candidate *x = a, *y = b;
+
+    if (x->size != y->size)
+        return x->size < y->size ? -1 : 1;
+    return 0;
+}
+
+static int compare_prefix(const void *a, const void *b) {
+    const struct candidate *x = a, *y = b;
+    int r = compare_size(a, b);
+
+    return r ? r : memcmp(x->prefix, y->prefix, sizeof(x->prefix));
+}
+
+static int compare_hash(const void *a, const void *b) {
+    const struct candidate *x = a, *y = b;
+    int r = compare_size(a, b);
+
+    return r ? r : memcmp(x->hash, y->hash, sizeof(x->hash));
+}
+
+/* groups ordered by digest, files in a group by path */
+static int compare_output(const void *a, const void *b) {
+    const struct candidate *x = a, *y = b;
+    int r = compare_hash(a, b);
+
+    return r ? r : strcmp(x->path, y->path);
+}
+
+/* Sort the candidates and keep only those equal to another one under
+ * compare, returns the new count. */
+static size_t keep_collisions(struct candidate *c, size_t count, int (*compare)(const void *, const void *)) {
+    size_t i, kept = 0;
+
+    qsort(c, count, sizeof(*c), compare);
+
+    for (i = 0; i < count; ++i) {
+        int collides = !c[i].failed &&
+            ((i > 0 && !c[i - 1].failed && compare(&c[i - 1], &c[i]) == 0) ||
+             (i + 1 < count && !c[i + 1].failed && compare(&c[i], &c[i + 1]) == 0));
+
+        if (collides)
+            c[kept++] = c[i];
+        else
+            free(c[i].path);
+    }
+    return kept;
+}
+
+static int hash_prefix(blake2b *prefix, blake2b *full, struct candidate *c) {
+    static __thread char buf[PREFIX_SIZE];
+    size_t len = 0;
+    int fd;
+
+    fd = open(c->path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    while (len < sizeof(buf)) {
+        ssize_t n = pread(fd, buf + len, sizeof(buf) - len, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            close(fd);
+            return -1;
+        }
+        if (n == 0)
+            break;
+        len += n;
+    }
+    close(fd);
+
+    /* small files are done here, the full digest needs no second stage */
+    return blake2b_hash(c->size <= PREFIX_SIZE ? full : prefix, buf, len, c->prefix);
+}
+
+static int hash_candidate(blake2b *b, struct candidate *c, size_t window) {
+    struct stat s;
+    int fd, r;
+
+    if (c->size <= PREFIX_SIZE) {
+        memcpy(c->hash, c->prefix, sizeof(c->hash));
+        return 0;
+    }
+
+    fd = open(c->path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    r = fstat(fd, &s);
+    if (r == 0 && s.st_size != c->size) {
+        errno = EAGAIN;
+        r = -1;
+    }
+    if (r == 0)
+        r = hash_fd(b, fd, s.st_size, window, -1, c->hash);
+    close(fd);
+    return r;
+}
+
+static void *stage_worker(void *arg) {
+    struct stage *stage = arg;
+    blake2b *prefix = blake2b_new();
+    blake2b *full = blake2b_new();
+
+    if (!prefix || !full ||
+        blake2b_set_digest_length(prefix, PREFIX_DIGEST_LENGTH) != 0 ||
+        blake2b_set_digest_length(full, 64) != 0) {
+        fprintf(stderr, "Could not create blake2b object\n");
+        exit(1);
+    }
+
+    for (;;) {
+        struct candidate *c;
+        int r;
+
+        pthread_mutex_lock(&stage->lock);
+        c = stage->next < stage->count ? &stage->candidates[stage->next++] : NULL;
+        pthread_mutex_unlock(&stage->lock);
+        if (!c)
+            break;
+
+        if (stage->full)
+            r = hash_candidate(full, c, stage->window);
+        else
+            r = hash_prefix(prefix, full, c);
+        if (r != 0) {
+            fprintf(stderr, "Could not hash file %s: %s\n", c->path, strerror(errno));
+            c->failed = 1;
+        }
+    }
+
+    blake2b_delete(prefix);
+    blake2b_delete(full);
+    return NULL;
+}
+
+/* hash all candidates on up to threads threads, 0 if none failed */
+static int run_stage(struct candidate *c, size_t count, int full, size_t window, long threads) {
+    struct stage stage = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .candidates = c,
+        .count = count,
+        .window = window,
+        .full = full,
+    };
+    pthread_t *t;
+    long i, started = 0;
+    size_t j;
+
+    if ((size_t) threads > count)
+        threads = count;
+
+    t = calloc(threads, sizeof(*t));
+    if (!t)
+        return -1;
+    for (i = 0; i < threads; ++i)
+        if (pthread_create(&t[i], NULL, stage_worker, &stage) == 0)
+            ++started;
+    /* with no thread at all do the work here */
+    if (started == 0)
+        stage_worker(&stage);
+    for (i = 0; i < started; ++i)
+        pthread_join(t[i], NULL);
+    free(t);
+
+    for (j = 0; j < count; ++j)
+        if (c[j].failed)
+            return -1;
+    return 0;
+}
+
+/* Print groups of identical files. Files are grouped by size first, then
+ * by a truncated digest of their first block, and only files still sharing
+ * both are hashed completely, so most data of unique files is never read. */
+static int find_duplicates(char **paths, int n, size_t window, long threads) {
+    size_t count, i;
+    int ret = 0;
+    int arg;
+
+    for (arg = 0; arg < n; ++arg) {
+        if (nftw(paths[arg], collect, 64, FTW_PHYS) != 0) {
+            fprintf(stderr, "Could not scan %s: %s\n", paths[arg], strerror(errno));
+            ret = 1;
+        }
+    }
+    if (found_errors)
+        ret = 1;
+
+    count = drop_same_files(found, found_count);
+    count = keep_collisions(found, count, compare_size);
+
+    if (count > 0 && run_stage(found, count, 0, window, threads) != 0)
+        ret = 1;
+    count = keep_collisions(found, count, compare_prefix);
+
+    if (count > 0 && run_stage(found, count, 1, window, threads) != 0)
+        ret = 1;
+    count = keep_collisions(found, count, compare_hash);
+    qsort(found, count, sizeof(*found), compare_output);
+
+    for (i = 0; i < count; ++i) {
+        if (i > 0 && compare_hash(&found[i - 1], &found[i]) != 0)
+            printf("\n");
+        if (print_hash(found[i].hash, found[i].path) != 0)
+            ret = 1;
+        free(found[i].path);
+    }
+
+    free(found);
+    return ret;
+}
+
 int main(int argc, char** argv) {
-    int i, r;
-    blake2b *b = blake2b_new();
+    static const struct option options[] = {
+        { "window",           required_argument, NULL, 'w' },
+        { "tee",              no_argument,       NULL, 't' },
+        { "digest-file",      required_argument, NULL, 'd' },
+        { "cache",            required_argument, NULL, 'c' },
+        { "rehash",           no_argument,       NULL, 'f' },
+        { "find-duplicates",  no_argument,       NULL, 'D' },
+        { "threads",          required_argument, NULL, 'j' },
+        { "help",             no_argument,       NULL, 'h' },
+        {}
+    };
+    size_t window = DEFAULT_WINDOW_SIZE;
+    const char *digest_file = NULL;
+    const char *cache_file = NULL;
+    struct digest_cache *cache = NULL;
+    int tee_mode = 0;
+    int rehash = 0;
+    int duplicates = 0;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    long page_size = sysconf(_SC_PAGESIZE);
+    int i, r, c;
+    int ret = 0;
+    blake2b *b;
+
+    while ((c = getopt_long(argc, argv, "w:td:c:fDj:h", options, NULL)) >= 0) {
+        switch (c) {
+        case 'w': {
+            char *end;
+            unsigned long long w = strtoull(optarg, &end, 10);
+            if (*end || w == 0) {
+                fprintf(stderr, "Invalid window size: %s\n", optarg);
+                return 1;
+            }
+            /* mmap offsets have to be page aligned */
+            window = (w + page_size - 1) / page_size * page_size;
+            break;
+        }
+        case 't':
+            tee_mode = 1;
+            break;
+        case 'd':
+            digest_file = optarg;
+            break;
+        case 'c':
+            cache_file = optarg;
+            break;
+        case 'f':
+            rehash = 1;
+            break;
+        case 'D':
+            duplicates = 1;
+            break;
+        case 'j':
+            threads = strtol(optarg, NULL, 10);
+            if (threads < 1) {
+                fprintf(stderr, "Invalid number of threads: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    b = blake2b_new();
     if (!b) {
-        printf("Could not create blake2b object}n", argv[i]);
+        printf("Could not create blake2b object\n");
         return 1;
     }
 
@@ -40,53 +728,85 @@ int main(int argc, char** argv) {
         return 1;
     }
 
-    for (i = 1; i < argc; ++i) {
+    if (duplicates) {
+        blake2b_delete(b);
+        if (threads < 1)
+            threads = 1;
+        return find_duplicates(argv + optind, argc - optind, window, threads);
+    }
+
+    if (tee_mode) {
+        if (argc - optind > 1) {
+            fprintf(stderr, "--tee takes at most one file\n");
+            blake2b_delete(b);
+            return 1;
+        }
+        ret = tee_main(b, optind < argc ? argv[optind] : NULL, window, digest_file);
+        blake2b_delete(b);
+        return ret;
+    }
+
+    if (cache_file) {
+        cache = digest_cache_open(cache_file);
+        if (!cache) {
+            printf("Could not open cache %s: %s\n", cache_file, strerror(errno));
+            blake2b_delete(b);
+            return 1;
+        }
+    }
+
+    for (i = optind; i < argc; ++i) {
         int fd;
         struct stat s;
-        const char *data;
         uint8_t hash[64];
-        char hex[129];
+
+        /* unchanged files are served from the cache without opening them */
+        if (cache && !rehash && stat(argv[i], &s) == 0 && S_ISREG(s.st_mode) &&
+            digest_cache_lookup(cache, &s, CACHE_PARAMS, hash) == 0) {
+            if (print_hash(hash, argv[i]) != 0)
+                ret = 1;
+            continue;
+        }
 
         fd = open(argv[i], O_RDONLY);
         if (fd < 0) {
             printf("Could not open file %s: %s\n", argv[i], strerror(errno));
+            ret = 1;
             continue;
         }
 
         r = fstat(fd, &s);
         if (r != 0) {
             printf("Could not stat file %s: %s\n", argv[i], strerror(errno));
+            close(fd);
+            ret = 1;
             continue;
         }
 
         if(!S_ISREG(s.st_mode)){
             printf("File is not a regular file: %s\n", argv[i]);
-            continue;
-        }
-        
-        data = mmap(NULL, s.st_size, PROT_READ, MAP_SHARED, fd, 0);
-        if (!data) {
-            printf("Could not mmap file %s: %s\n", argv[i], strerror(errno));
+            close(fd);
+            ret = 1;
             continue;
         }
 
-        r = blake2b_hash(b, data, s.st_size, hash);
+        r = hash_fd(b, fd, s.st_size, window, -1, hash);
+        close(fd);
         if (r != 0) {
-            printf("Could not hash file %s\n", argv[i]);
+            printf("Could not hash file %s: %s\n", argv[i], strerror(errno));
+            ret = 1;
             continue;
         }
 
-        r = blake2b_hash_to_hex(hash, 64, hex);
-        if (r != 0) {
-            printf("Could not convert to hex: %s\n", argv[i]);
-            continue;
-        }
+        if (cache && digest_cache_store(cache, &s, CACHE_PARAMS, hash) != 0)
+            fprintf(stderr, "Could not update cache for %s: %s\n", argv[i], strerror(errno));
 
-        printf("%s  %s\n", hex, argv[i]);
-        close(fd);
+        if (print_hash(hash, argv[i]) != 0)
+            ret = 1;
     }
 
+    digest_cache_close(cache);
     blake2b_delete(b);
 
-    return 0;
+    return ret;
 }
@@ -41,9 +41,13 @@ BLAKE2_EXPORT_SYMBOL blake2b *blake2b_new();
 
 BLAKE2_EXPORT_SYMBOL void blake2b_delete(blake2b* b);
 
+BLAKE2_EXPORT_SYMBOL blake2b *blake2b_clone(const blake2b *b);
+
+BLAKE2_EXPORT_SYMBOL int blake2b_copy_state(blake2b *dst, const blake2b *src);
+
 BLAKE2_EXPORT_SYMBOL int blake2b_set_digest_length(blake2b *b, const size_t digest_len);
 
-int blake2b_set_key(blake2b *b, const char *const key, const size_t key_len);
+BLAKE2_EXPORT_SYMBOL int blake2b_set_key(blake2b *b, const char *const key, const size_t key_len);
 
 BLAKE2_EXPORT_SYMBOL int blake2b_set_salt(blake2b *b, const char *const salt, const size_t salt_len);
 
@@ -51,6 +55,42 @@ BLAKE2_EXPORT_SYMBOL int blake2b_set_personalization(blake2b *b, const char * co
 
 BLAKE2_EXPORT_SYMBOL int blake2b_hash(blake2b *b, const char *const message, const size_t len, uint8_t *const hash);
 
+/* like blake2b_hash() but hashed by the blake2bd daemon listening on the
+ * socket named by $BLAKE2BD_SOCKET (/run/blake2bd.sock if unset), which
+ * batches requests from many processes. The daemon is only used if it runs
+ * as root or as the calling user. Keyed objects are always hashed in
+ * process so the key is never sent. Falls back to hashing in process if
+ * the daemon can't be reached or doesn't answer in time */
+BLAKE2_EXPORT_SYMBOL int blake2b_hash_daemon(blake2b *b, const char *const message, const size_t len, uint8_t *const hash);
+
+BLAKE2_EXPORT_SYMBOL int blake2b_reset(blake2b *b);
+
+BLAKE2_EXPORT_SYMBOL int blake2b_update(blake2b *b, const char *const data, const size_t len);
+
+/* finishes the incremental hash. until blake2b_reset() is called again
+ * blake2b_update(), blake2b_final() and blake2b_final_suffix() return -1 */
+BLAKE2_EXPORT_SYMBOL int blake2b_final(blake2b *b, uint8_t *const hash);
+
+/* hash the data passed to blake2b_update() so far followed by suffix,
+ * leaving b untouched so it can be reused for the next suffix */
+BLAKE2_EXPORT_SYMBOL int blake2b_final_suffix(const blake2b *b, const char *const suffix, const size_t len, uint8_t *const hash);
+
+/* size of the buffer needed by blake2b_export_state() */
+#define BLAKE2B_STATE_SIZE 296
+
+BLAKE2_EXPORT_SYMBOL int blake2b_export_state(const blake2b *b, uint8_t *const state, const size_t state_len);
+
+BLAKE2_EXPORT_SYMBOL int blake2b_import_state(blake2b *b, const uint8_t *const state, const size_t state_len);
+
+/* Argon2id (RFC 9106) with t_cost passes over m_cost KiB of memory split
+ * into parallelism lanes. secret and ad may be NULL if their length is 0 */
+BLAKE2_EXPORT_SYMBOL int blake2b_argon2id(const uint32_t t_cost, const uint32_t m_cost, const uint32_t parallelism,
+					  const char *const password, const size_t password_len,
+					  const char *const salt, const size_t salt_len,
+					  const char *const secret, const size_t secret_len,
+					  const char *const ad, const size_t ad_len,
+					  uint8_t *const tag, const size_t tag_len);
+
 BLAKE2_EXPORT_SYMBOL int blake2b_hash_to_hex(const uint8_t * const hash, const size_t hlen, char *const output);
 
 BLAKE2_EXPORT_SYMBOL int blake2b_hex_to_hash(const char *const hex, const size_t hexlen, uint8_t *const hash, const size_t hashlen);
@@ -0,0 +1,66 @@
+/***
+  This file is part of libblake2
+
+  Copyright 2015 Mirco Tischler
+
+  libblake2 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  libblake2 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with libblake2; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#ifndef BLAKE2BD_PROTOCOL_H
+#define	BLAKE2BD_PROTOCOL_H
+
+#include <inttypes.h>
+
+#include "blake2b.h"
+
+/* The wire format between blake2b_hash_daemon() and blake2bd.
+ *
+ * Requests and responses are single messages on a SOCK_SEQPACKET unix
+ * socket. A request carries the serialized state to start from (see
+ * blake2b_export_state()) and the payload, either inline after the header
+ * or, for larger payloads, in a sealed memfd passed with SCM_RIGHTS. */
+
+#define BLAKE2BD_MAGIC 0x44623242 /* "B2bD" */
+#define BLAKE2BD_VERSION 1
+
+/* payloads up to this size are sent inline */
+#define BLAKE2BD_INLINE_MAX (16 * 1024)
+
+/* the socket used if BLAKE2BD_SOCKET is not set in the environment */
+#define BLAKE2BD_SOCKET_PATH "/run/blake2bd.sock"
+
+/* a client waits this long for a request of up to BLAKE2BD_TIMEOUT_BYTES,
+ * and that long again for every further BLAKE2BD_TIMEOUT_BYTES */
+#define BLAKE2BD_TIMEOUT_SECONDS 2
+#define BLAKE2BD_TIMEOUT_BYTES (64 * 1024 * 1024)
+
+/* state must be a fresh, unkeyed state as exported right after
+ * blake2b_reset(), the daemon refuses anything else */
+struct blake2bd_request {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t length;
+    /* 1 if the payload follows inline, 0 if a memfd is attached */
+    uint32_t inline_payload;
+    uint32_t reserved;
+    uint8_t state[BLAKE2B_STATE_SIZE];
+};
+
+struct blake2bd_response {
+    int32_t status;
+    uint32_t reserved;
+    uint8_t hash[64];
+};
+
+#endif	// BLAKE2BD_PROTOCOL_H
@@ -0,0 +1,365 @@
+/***
+  This file is part of libblake2
+
+  Copyright 2015 Mirco Tischler
+
+  libblake2 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  libblake2 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with libblake2; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <blake2b.h>
+
+#include "blake2bd-protocol.h"
+
+#define MAX_CLIENTS 1024
+
+/* a request read from a client and its response */
+struct job {
+    int fd;
+    struct blake2bd_request request;
+    const char *payload;
+    /* the length of the memfd mapping, 0 for inline payloads */
+    size_t mapped;
+    struct blake2bd_response response;
+};
+
+/* The requests that arrived during one poll round form a batch, the
+ * batch is spread over the worker threads. */
+struct pool {
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    struct job *jobs;
+    size_t count;
+    size_t next;
+    size_t finished;
+};
+
+static volatile sig_atomic_t quit = 0;
+
+static void usage(const char *name) {
+    printf("Usage: %s [OPTION]...\n"
+           "Serve BLAKE2b hash requests on a unix socket.\n\n"
+           "  -s, --socket=PATH    listen on PATH (default $BLAKE2BD_SOCKET or %s)\n"
+           "  -j, --threads=N      hash on N threads (default: number of CPUs)\n"
+           "  -h, --help           display this help and exit\n",
+           name, BLAKE2BD_SOCKET_PATH);
+}
+
+static void on_signal(int sig) {
+    (void) sig;
+    quit = 1;
+}
+
+/* Only fresh states are served: an empty buffer, no key and a zero counter
+ * and final flags, see the layout in Blake2b.cpp. Anything else could not
+ * have come from blake2b_hash_daemon(). */
+static int fresh_state(const uint8_t *state) {
+    size_t i;
+
+    if (state[5] != 0 || state[6] != 0 || state[9] != 0)
+        return 0;
+    for (i = 136; i < 168; ++i)
+        if (state[i] != 0)
+            return 0;
+    return 1;
+}
+
+static void process(blake2b *b, struct job *job) {
+    int r = -1;
+
+    if (fresh_state(job->request.state))
+        r = blake2b_import_state(b, job->request.state, sizeof(job->request.state));
+    if (r == 0)
+        r = blake2b_update(b, job->payload, job->request.length);
+    if (r == 0)
+        r = blake2b_final(b, job->response.hash);
+    job->response.status = r;
+}
+
+static void *worker(void *arg) {
+    struct pool *pool = arg;
+    blake2b *b = blake2b_new();
+
+    if (!b) {
+        fprintf(stderr, "Could not create blake2b object\n");
+        exit(1);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        struct job *job;
+
+        while (pool->next >= pool->count)
+            pthread_cond_wait(&pool->work, &pool->lock);
+        job = &pool->jobs[pool->next++];
+        pthread_mutex_unlock(&pool->lock);
+
+        process(b, job);
+
+        pthread_mutex_lock(&pool->lock);
+        if (++pool->finished == pool->count)
+            pthread_cond_signal(&pool->done);
+    }
+
+    return NULL;
+}
+
+static void run_batch(struct pool *pool, struct job *jobs, size_t count) {
+    pthread_mutex_lock(&pool->lock);
+    pool->jobs = jobs;
+    pool->count = count;
+    pool->next = 0;
+    pool->finished = 0;
+    pthread_cond_broadcast(&pool->work);
+    while (pool->finished < count)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pool->count = 0;
+    pool->next = 0;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* 0 if a request was read, 1 on end of file and -1 on errors */
+static int read_request(int fd, struct job *job, char *buffer) {
+    union {
+        struct cmsghdr header;
+        char data[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct iovec iov = { buffer, sizeof(struct blake2bd_request) + BLAKE2BD_INLINE_MAX };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = &control,
+        .msg_controllen = sizeof(control),
+    };
+    struct cmsghdr *cmsg;
+    int memfd = -1;
+    ssize_t n;
+
+    n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC | MSG_DONTWAIT);
+    if (n == 0)
+        return 1;
+    if (n < 0)
+        return errno == EAGAIN ? 1 : -1;
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            memcpy(&memfd, CMSG_DATA(cmsg), sizeof(int));
+
+    memset(job, 0, sizeof(*job));
+    job->fd = fd;
+    if ((size_t) n < sizeof(job->request) || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)))
+        goto fail;
+    memcpy(&job->request, buffer, sizeof(job->request));
+    if (job->request.magic != BLAKE2BD_MAGIC || job->request.version != BLAKE2BD_VERSION)
+        goto fail;
+
+    if (job->request.inline_payload) {
+        if ((size_t) n - sizeof(job->request) != job->request.length || memfd >= 0)
+            goto fail;
+        job->payload = buffer + sizeof(job->request);
+        return 0;
+    }
+
+    /* only sealed memfds can't shrink under the mapping */
+    if (memfd < 0 || !(fcntl(memfd, F_GET_SEALS) & F_SEAL_SHRINK))
+        goto fail;
+
+    if (job->request.length > 0) {
+        struct stat s;
+
+        if (fstat(memfd, &s) != 0 || (uint64_t) s.st_size < job->request.length)
+            goto fail;
+        job->payload = mmap(NULL, job->request.length, PROT_READ, MAP_PRIVATE, memfd, 0);
+        if (job->payload == MAP_FAILED)
+            goto fail;
+        job->mapped = job->request.length;
+    }
+    close(memfd);
+    return 0;
+
+fail:
+    if (memfd >= 0)
+        close(memfd);
+    return -1;
+}
+
+static int listen_on(const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0)
+        return -1;
+
+    unlink(path);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+        chmod(path, 0666) != 0 ||
+        listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int main(int argc, char** argv) {
+    static const struct option options[] = {
+        { "socket",  required_argument, NULL, 's' },
+        { "threads", required_argument, NULL, 'j' },
+        { "help",    no_argument,       NULL, 'h' },
+        {}
+    };
+    static struct pollfd fds[MAX_CLIENTS + 1];
+    static struct job jobs[MAX_CLIENTS];
+    static char buffers[MAX_CLIENTS][sizeof(struct blake2bd_request) + BLAKE2BD_INLINE_MAX];
+    struct pool pool = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .work = PTHREAD_COND_INITIALIZER,
+        .done = PTHREAD_COND_INITIALIZER,
+    };
+    const char *path = getenv("BLAKE2BD_SOCKET");
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    struct sigaction sa = { .sa_handler = on_signal };
+    size_t clients = 0;
+    long i;
+    int c;
+
+    while ((c = getopt_long(argc, argv, "s:j:h", options, NULL)) >= 0) {
+        switch (c) {
+        case 's':
+            path = optarg;
+            break;
+        case 'j':
+            threads = strtol(optarg, NULL, 10);
+            if (threads < 1) {
+                fprintf(stderr, "Invalid number of threads: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!path)
+        path = BLAKE2BD_SOCKET_PATH;
+    if (threads < 1)
+        threads = 1;
+
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    fds[0].fd = listen_on(path);
+    fds[0].events = POLLIN;
+    if (fds[0].fd < 0) {
+        fprintf(stderr, "Could not listen on %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    for (i = 0; i < threads; ++i) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, worker, &pool) != 0) {
+            fprintf(stderr, "Could not start worker thread: %s\n", strerror(errno));
+            unlink(path);
+            return 1;
+        }
+        pthread_detach(t);
+    }
+
+    while (!quit) {
+        size_t count = 0, j;
+
+        if (poll(fds, clients + 1, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "poll failed: %s\n", strerror(errno));
+            break;
+        }
+
+        /* collect one request from every client that has one */
+        for (j = 1; j <= clients; ++j) {
+            int r = 1;
+
+            /* no one is left to read the reply to anything still queued */
+            if (fds[j].revents & (POLLHUP | POLLERR))
+                r = -1;
+            else if (fds[j].revents & POLLIN)
+                r = read_request(fds[j].fd, &jobs[count], buffers[count]);
+            if (r == 0) {
+                ++count;
+                continue;
+            }
+            if (r < 0) {
+                close(fds[j].fd);
+                fds[j] = fds[clients--];
+                --j;
+            }
+        }
+
+        if (count > 0)
+            run_batch(&pool, jobs, count);
+
+        /* a client that doesn't read its replies must not block the
+         * daemon, shut it down and poll() reports the hangup next round */
+        for (j = 0; j < count; ++j) {
+            if (send(jobs[j].fd, &jobs[j].response, sizeof(jobs[j].response),
+                     MSG_NOSIGNAL | MSG_DONTWAIT) != sizeof(jobs[j].response))
+                shutdown(jobs[j].fd, SHUT_RDWR);
+            if (jobs[j].mapped)
+                munmap((void *) jobs[j].payload, jobs[j].mapped);
+        }
+
+        while (clients < MAX_CLIENTS && (fds[0].revents & POLLIN)) {
+            int fd = accept4(fds[0].fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+            if (fd < 0)
+                break;
+            ++clients;
+            fds[clients].fd = fd;
+            fds[clients].events = POLLIN;
+            fds[clients].revents = 0;
+        }
+    }
+
+    close(fds[0].fd);
+    unlink(path);
+
+    return 0;
+}
@@ -0,0 +1,308 @@
+/***
+  This file is part of libblake2
+
+  Copyright 2015 Mirco Tischler
+
+  libblake2 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  libblake2 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with libblake2; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "digest-cache.h"
+
+#define CACHE_MAGIC "B2bC"
+#define CACHE_VERSION 2
+#define INITIAL_SLOTS 4096
+
+/* files changed this recently may still be changing within the timestamp
+ * granularity, they are not cached */
+#define RACY_SECONDS 2
+
+/* The file is a header followed by an open addressing hash table with
+ * linear probing on (dev, ino). The table is grown to keep it at most
+ * three quarters full. */
+struct cache_header {
+    char magic[4];
+    uint32_t version;
+    uint64_t slots;
+    uint64_t used;
+    uint64_t reserved[5];
+};
+
+struct cache_entry {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    uint64_t mtime_ns;
+    uint64_t ctime_ns;
+    uint64_t params;
+    uint64_t valid;
+    /* FNV-1a of the fields above and the digest, so a torn entry is never
+     * served */
+    uint64_t check;
+    uint8_t digest[64];
+};
+
+struct digest_cache {
+    int fd;
+    size_t length;
+    struct cache_header *header;
+    struct cache_entry *entries;
+};
+
+static uint64_t fnv1a(uint64_t h, const void *data, size_t length) {
+    const uint8_t *p = data;
+
+    while (length--) {
+        h ^= *p++;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/* covers everything an entry stores except valid and check themselves */
+static uint64_t entry_check(const struct cache_entry *e) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    h = fnv1a(h, e, offsetof(struct cache_entry, valid));
+    return fnv1a(h, e->digest, sizeof(e->digest));
+}
+
+static size_t cache_length(uint64_t slots) {
+    return sizeof(struct cache_header) + slots * sizeof(struct cache_entry);
+}
+
+static uint64_t timestamp_ns(const struct timespec *t) {
+    return (uint64_t) t->tv_sec * 1000000000ULL + t->tv_nsec;
+}
+
+static int map(struct digest_cache *c, uint64_t slots) {
+    size_t length = cache_length(slots);
+    void *data;
+
+    if (ftruncate(c->fd, length) != 0)
+        return -1;
+
+    data = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0);
+    if (data == MAP_FAILED)
+        return -1;
+
+    c->length = length;
+    c->header = data;
+    c->entries = (struct cache_entry *) (c->header + 1);
+    return 0;
+}
+
+static void unmap(struct digest_cache *c) {
+    if (c->header)
+        munmap(c->header, c->length);
+    c->header = NULL;
+    c->entries = NULL;
+}
+
+static int valid_header(const struct cache_header *h, size_t length) {
+    return memcmp(h->magic, CACHE_MAGIC, 4) == 0 &&
+           h->version == CACHE_VERSION &&
+           h->slots > 0 && (h->slots & (h->slots - 1)) == 0 &&
+           h->used < h->slots &&
+           cache_length(h->slots) == length;
+}
+
+static int initialize(struct digest_cache *c, uint64_t slots) {
+    unmap(c);
+    if (ftruncate(c->fd, 0) != 0 || map(c, slots) != 0)
+        return -1;
+
+    memcpy(c->header->magic, CACHE_MAGIC, 4);
+    c->header->version = CACHE_VERSION;
+    c->header->slots = slots;
+    c->header->used = 0;
+    return 0;
+}
+
+static uint64_t slot_of(uint64_t dev, uint64_t ino, uint64_t slots) {
+    uint64_t h = (dev * 0x9e3779b97f4a7c15ULL) ^ ino;
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h & (slots - 1);
+}
+
+/* the entry for (dev, ino) or the empty slot where it belongs, NULL if
+ * there is no empty slot, which only a corrupt table can cause */
+static struct cache_entry *probe(struct digest_cache *c, uint64_t dev, uint64_t ino) {
+    uint64_t mask = c->header->slots - 1;
+    uint64_t i = slot_of(dev, ino, c->header->slots);
+    uint64_t n;
+
+    for (n = 0; n < c->header->slots; ++n) {
+        if (!c->entries[i].valid ||
+            (c->entries[i].dev == dev && c->entries[i].ino == ino))
+            return &c->entries[i];
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+/* like probe() but a corrupt table is started over, it is only a cache */
+static struct cache_entry *find(struct digest_cache *c, uint64_t dev, uint64_t ino) {
+    struct cache_entry *e = probe(c, dev, ino);
+
+    if (e || initialize(c, INITIAL_SLOTS) != 0)
+        return e;
+    return probe(c, dev, ino);
+}
+
+static int grow(struct digest_cache *c) {
+    uint64_t slots = c->header->slots;
+    uint64_t i, n = 0;
+    struct cache_entry *old;
+
+    old = malloc(c->header->used * sizeof(*old));
+    if (!old && c->header->used > 0)
+        return -1;
+    for (i = 0; i < slots; ++i) {
+        if (!c->entries[i].valid)
+            continue;
+        /* more entries than counted, the table is corrupt */
+        if (n == c->header->used) {
+            free(old);
+            return initialize(c, INITIAL_SLOTS);
+        }
+        old[n++] = c->entries[i];
+    }
+
+    if (initialize(c, slots * 2) != 0) {
+        free(old);
+        return -1;
+    }
+
+    for (i = 0; i < n; ++i)
+        *find(c, old[i].dev, old[i].ino) = old[i];
+    c->header->used = n;
+
+    free(old);
+    return 0;
+}
+
+struct digest_cache *digest_cache_open(const char *path) {
+    struct digest_cache *c;
+    struct stat s;
+    int r;
+
+    c = calloc(1, sizeof(*c));
+    if (!c)
+        return NULL;
+
+    c->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (c->fd < 0) {
+        free(c);
+        return NULL;
+    }
+
+    /* concurrent runs would corrupt the table */
+    r = flock(c->fd, LOCK_EX);
+    if (r == 0)
+        r = fstat(c->fd, &s);
+
+    if (r == 0 && (size_t) s.st_size >= sizeof(struct cache_header)) {
+        struct cache_header h;
+
+        if (pread(c->fd, &h, sizeof(h), 0) == sizeof(h) && valid_header(&h, s.st_size))
+            r = map(c, h.slots);
+        else
+            r = initialize(c, INITIAL_SLOTS);
+    } else if (r == 0) {
+        /* a new or truncated cache, it is only a cache so start over */
+        r = initialize(c, INITIAL_SLOTS);
+    }
+
+    if (r != 0) {
+        int e = errno;
+        digest_cache_close(c);
+        errno = e;
+        return NULL;
+    }
+
+    return c;
+}
+
+void digest_cache_close(struct digest_cache *c) {
+    if (!c)
+        return;
+
+    unmap(c);
+    close(c->fd);
+    free(c);
+}
+
+int digest_cache_lookup(struct digest_cache *c, const struct stat *s, uint64_t params, uint8_t *digest) {
+    const struct cache_entry *e = find(c, s->st_dev, s->st_ino);
+
+    if (!e || !e->valid ||
+        e->check != entry_check(e) ||
+        e->size != (uint64_t) s->st_size ||
+        e->mtime_ns != timestamp_ns(&s->st_mtim) ||
+        e->ctime_ns != timestamp_ns(&s->st_ctim) ||
+        e->params != params)
+        return -1;
+
+    memcpy(digest, e->digest, sizeof(e->digest));
+    return 0;
+}
+
+int digest_cache_store(struct digest_cache *c, const struct stat *s, uint64_t params, const uint8_t *digest) {
+    struct cache_entry *e;
+    time_t now = time(NULL);
+
+    if (s->st_mtim.tv_sec + RACY_SECONDS >= now || s->st_ctim.tv_sec + RACY_SECONDS >= now)
+        return 0;
+
+    if ((c->header->used + 1) * 4 > c->header->slots * 3 && grow(c) != 0)
+        return -1;
+
+    e = find(c, s->st_dev, s->st_ino);
+    if (!e)
+        return -1;
+    if (!e->valid)
+        ++c->header->used;
+
+    /* the entry is only valid again once the digest, the metadata and
+     * their check are in place, so an interrupted store leaves it invalid */
+    e->valid = 0;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    memcpy(e->digest, digest, sizeof(e->digest));
+    e->dev = s->st_dev;
+    e->ino = s->st_ino;
+    e->size = s->st_size;
+    e->mtime_ns = timestamp_ns(&s->st_mtim);
+    e->ctime_ns = timestamp_ns(&s->st_ctim);
+    e->params = params;
+    e->check = entry_check(e);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    e->valid = 1;
+
+    return 0;
+}
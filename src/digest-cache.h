@@ -0,0 +1,42 @@
+/***
+  This file is part of libblake2
+
+  Copyright 2015 Mirco Tischler
+
+  libblake2 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  libblake2 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with libblake2; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#ifndef DIGEST_CACHE_H
+#define	DIGEST_CACHE_H
+
+#include <inttypes.h>
+#include <sys/stat.h>
+
+/* A persistent, memory mapped table of file digests keyed by device, inode,
+ * size, mtime, ctime and the hash parameters. A file whose metadata still
+ * matches its entry does not need to be read again. */
+struct digest_cache;
+
+/* opens or creates the cache at path and locks it for the calling process,
+ * returns NULL and sets errno on failure */
+struct digest_cache *digest_cache_open(const char *path);
+
+void digest_cache_close(struct digest_cache *c);
+
+/* 0 and the digest if s matches an entry, -1 otherwise */
+int digest_cache_lookup(struct digest_cache *c, const struct stat *s, uint64_t params, uint8_t *digest);
+
+int digest_cache_store(struct digest_cache *c, const struct stat *s, uint64_t params, const uint8_t *digest);
+
+#endif	// DIGEST_CACHE_H
@@ -0,0 +1,74 @@
+/***
+  This file is part of libblake2
+
+  Copyright 2015 Mirco Tischler
+
+  libblake2 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  libblake2 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with libblake2; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#include <gtest/gtest.h>
+
+#include "blake2b.h"
+
+#include <string>
+
+namespace {
+
+// RFC 9106, section 5.3
+auto rfc_tag = "0d640df58d78766c08c037a34a8b53c9d01ef0452d75b65eb52520e96b01e659";
+
+TEST(testArgon2, rfc9106) {
+	auto password = std::string(32, '\x01');
+	auto salt = std::string(16, '\x02');
+	auto secret = std::string(8, '\x03');
+	auto ad = std::string(12, '\x04');
+	uint8_t tag[32];
+
+	auto ret = blake2b_argon2id(3, 32, 4,
+				    password.data(), password.size(),
+				    salt.data(), salt.size(),
+				    secret.data(), secret.size(),
+				    ad.data(), ad.size(),
+				    tag, sizeof(tag));
+	ASSERT_EQ(0, ret);
+	char hex[65];
+	ASSERT_EQ(0, blake2b_hash_to_hex(tag, 32, hex));
+	ASSERT_STRCASEEQ(rfc_tag, hex);
+}
+
+TEST(testArgon2, singleLaneLongTag) {
+	uint8_t a[100], b[100];
+	ASSERT_EQ(0, blake2b_argon2id(2, 64, 1, "password", 8, "somesalt", 8, nullptr, 0, nullptr, 0, a, sizeof(a)));
+	ASSERT_EQ(0, blake2b_argon2id(2, 64, 1, "password", 8, "somesalt", 8, nullptr, 0, nullptr, 0, b, sizeof(b)));
+	ASSERT_EQ(0, memcmp(a, b, sizeof(a)));
+	ASSERT_EQ(0, blake2b_argon2id(2, 64, 1, "passwore", 8, "somesalt", 8, nullptr, 0, nullptr, 0, b, sizeof(b)));
+	ASSERT_NE(0, memcmp(a, b, sizeof(a)));
+}
+
+TEST(testArgon2, invalidParameters) {
+	uint8_t tag[32];
+	// less than 8 KiB per lane
+	ASSERT_EQ(-1, blake2b_argon2id(1, 16, 4, "password", 8, "somesalt", 8, nullptr, 0, nullptr, 0, tag, sizeof(tag)));
+	// salt too short
+	ASSERT_EQ(-1, blake2b_argon2id(1, 64, 1, "password", 8, "salt", 4, nullptr, 0, nullptr, 0, tag, sizeof(tag)));
+	ASSERT_EQ(-1, blake2b_argon2id(0, 64, 1, "password", 8, "somesalt", 8, nullptr, 0, nullptr, 0, tag, sizeof(tag)));
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	::testing::InitGoogleTest(&argc, argv);
+
+	return RUN_ALL_TESTS();
+}
@@ -20,6 +20,16 @@
 #include <gtest/gtest.h>
 
 #include "blake2b.h"
+#include "AsyncBlake2b.hpp"
+#include "Blake2bHasher.hpp"
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace {
 
@@ -68,6 +78,357 @@ TEST_F(Blake2bTest, pangram) {
 	ASSERT_STRCASEEQ(pangram_hash, hex);
 }
 
+TEST_F(Blake2bTest, incrementalPangram) {
+	uint8_t hash[64];
+	auto s = "The quick brown fox jumps over the lazy dog";
+	ASSERT_EQ(0, blake2b_update(b, s, 10));
+	ASSERT_EQ(0, blake2b_update(b, s + 10, 33));
+	ASSERT_EQ(0, blake2b_final(b, hash));
+	char hex[129];
+	ASSERT_EQ(0, blake2b_hash_to_hex(hash, 64, hex));
+	ASSERT_STRCASEEQ(pangram_hash, hex);
+}
+
+TEST_F(Blake2bTest, incrementalMatchesOneShot) {
+	std::string data;
+	for (auto i = 0u; i < 600; ++i)
+		data.push_back(static_cast<char> (i * 7 + 3));
+
+	for (auto len : {0u, 1u, 127u, 128u, 129u, 255u, 256u, 257u, 600u}) {
+		uint8_t expected[64];
+		ASSERT_EQ(0, blake2b_hash(b, data.data(), len, expected));
+		for (auto split : {0u, 1u, 64u, 128u, 129u}) {
+			if (split > len)
+				continue;
+			uint8_t hash[64];
+			ASSERT_EQ(0, blake2b_reset(b));
+			ASSERT_EQ(0, blake2b_update(b, data.data(), split));
+			ASSERT_EQ(0, blake2b_update(b, data.data() + split, len - split));
+			ASSERT_EQ(0, blake2b_final(b, hash));
+			ASSERT_EQ(0, memcmp(expected, hash, 64)) << "len " << len << " split " << split;
+		}
+	}
+}
+
+TEST_F(Blake2bTest, exportImportState) {
+	std::string data(1000, 'x');
+	uint8_t expected[64];
+	ASSERT_EQ(0, blake2b_hash(b, data.data(), data.size(), expected));
+
+	ASSERT_EQ(0, blake2b_update(b, data.data(), 300));
+	std::vector<uint8_t> state(BLAKE2B_STATE_SIZE);
+	ASSERT_EQ(0, blake2b_export_state(b, state.data(), state.size()));
+
+	blake2b *resumed = blake2b_new();
+	ASSERT_EQ(0, blake2b_import_state(resumed, state.data(), state.size()));
+	ASSERT_EQ(0, blake2b_update(resumed, data.data() + 300, 700));
+	uint8_t hash[64];
+	ASSERT_EQ(0, blake2b_final(resumed, hash));
+	blake2b_delete(resumed);
+	ASSERT_EQ(0, memcmp(expected, hash, 64));
+}
+
+TEST_F(Blake2bTest, useAfterFinal) {
+	uint8_t hash[64];
+	ASSERT_EQ(0, blake2b_update(b, "abc", 3));
+	ASSERT_EQ(0, blake2b_final(b, hash));
+	ASSERT_EQ(-1, blake2b_update(b, "abc", 3));
+	ASSERT_EQ(-1, blake2b_final(b, hash));
+	ASSERT_EQ(-1, blake2b_final_suffix(b, "abc", 3, hash));
+
+	ASSERT_EQ(0, blake2b_reset(b));
+	ASSERT_EQ(0, blake2b_update(b, "abc", 3));
+	ASSERT_EQ(0, blake2b_final(b, hash));
+}
+
+TEST_F(Blake2bTest, importRejectsCorruptState) {
+	std::vector<uint8_t> state(BLAKE2B_STATE_SIZE);
+	ASSERT_EQ(0, blake2b_export_state(b, state.data(), state.size()));
+	ASSERT_EQ(-1, blake2b_import_state(b, state.data(), state.size() - 1));
+	state[0] = 'X';
+	ASSERT_EQ(-1, blake2b_import_state(b, state.data(), state.size()));
+
+	std::vector<uint8_t> fresh(BLAKE2B_STATE_SIZE);
+	ASSERT_EQ(0, blake2b_reset(b));
+	ASSERT_EQ(0, blake2b_export_state(b, fresh.data(), fresh.size()));
+	ASSERT_EQ(0, blake2b_import_state(b, fresh.data(), fresh.size()));
+
+	// buffer length beyond a block
+	state = fresh;
+	state[5] = 129;
+	ASSERT_EQ(-1, blake2b_import_state(b, state.data(), state.size()));
+
+	// finalized
+	state = fresh;
+	state[152] = 0xff;
+	ASSERT_EQ(-1, blake2b_import_state(b, state.data(), state.size()));
+	state = fresh;
+	state[160] = 0xff;
+	ASSERT_EQ(-1, blake2b_import_state(b, state.data(), state.size()));
+
+	// compressed blocks but an empty buffer
+	state = fresh;
+	state[136] = 128;
+	ASSERT_EQ(-1, blake2b_import_state(b, state.data(), state.size()));
+
+	// a counter that is not a multiple of the block size
+	state = fresh;
+	state[5] = 10;
+	state[136] = 1;
+	ASSERT_EQ(-1, blake2b_import_state(b, state.data(), state.size()));
+
+	// a rejected import leaves the object usable
+	uint8_t expected[64], hash[64];
+	ASSERT_EQ(0, blake2b_hash(b, "abc", 3, expected));
+	ASSERT_EQ(0, blake2b_update(b, "abc", 3));
+	ASSERT_EQ(0, blake2b_final(b, hash));
+	ASSERT_EQ(0, memcmp(expected, hash, 64));
+}
+
+TEST_F(Blake2bTest, sharedPrefix) {
+	std::string prefix(4096, 'p');
+	ASSERT_EQ(0, blake2b_update(b, prefix.data(), prefix.size()));
+
+	for (auto suffix : {"", "a", "record 1", "a somewhat longer record that spans more than a single block of the compression function, 128 bytes"}) {
+		auto message = prefix + suffix;
+		uint8_t expected[64];
+		ASSERT_EQ(0, blake2b_hash(b, message.data(), message.size(), expected));
+		uint8_t hash[64];
+		ASSERT_EQ(0, blake2b_final_suffix(b, suffix, strlen(suffix), hash));
+		ASSERT_EQ(0, memcmp(expected, hash, 64)) << suffix;
+	}
+}
+
+TEST_F(Blake2bTest, cloneIsIndependent) {
+	ASSERT_EQ(0, blake2b_update(b, "prefix", 6));
+	blake2b *c = blake2b_clone(b);
+	ASSERT_NE(nullptr, c);
+	ASSERT_EQ(0, blake2b_update(c, "suffix", 6));
+
+	uint8_t expected[64];
+	ASSERT_EQ(0, blake2b_hash(b, "prefixsuffix", 12, expected));
+	uint8_t hash[64];
+	ASSERT_EQ(0, blake2b_final(c, hash));
+	ASSERT_EQ(0, memcmp(expected, hash, 64));
+
+	ASSERT_EQ(0, blake2b_copy_state(c, b));
+	ASSERT_EQ(0, blake2b_final(c, hash));
+	ASSERT_EQ(0, blake2b_hash(b, "prefix", 6, expected));
+	ASSERT_EQ(0, memcmp(expected, hash, 64));
+	blake2b_delete(c);
+}
+
+TEST_F(Blake2bTest, keyed) {
+	char key[64];
+	for (auto i = 0u; i < 64; ++i)
+		key[i] = static_cast<char> (i);
+	ASSERT_EQ(0, blake2b_set_key(b, key, 64));
+
+	std::string data;
+	for (auto i = 0u; i < 255; ++i)
+		data.push_back(static_cast<char> (i));
+
+	const struct {
+		size_t len;
+		const char *hash;
+	} vectors[] = {
+		{0, "10ebb67700b1868efb4417987acf4690ae9d972fb7a590c2f02871799aaa4786b5e996e8f0f4eb981fc214b005f42d2ff4233499391653df7aefcbc13fc51568"},
+		{3, "33d0825dddf7ada99b0e7e307104ad07ca9cfd9692214f1561356315e784f3e5a17e364ae9dbb14cb2036df932b77f4b292761365fb328de7afdc6d8998f5fc1"},
+		{128, "72065ee4dd91c2d8509fa1fc28a37c7fc9fa7d5b3f8ad3d0d7a25626b57b1b44788d4caf806290425f9890a3a2a35a905ab4b37acfd0da6e4517b2525c9651e4"},
+		{255, "142709d62e28fcccd0af97fad0f8465b971e82201dc51070faa0372aa43e92484be1c1e73ba10906d5d1853db6a4106e0a7bf9800d373d6dee2d46d62ef2a461"},
+	};
+	for (const auto &v : vectors) {
+		uint8_t hash[64];
+		char hex[129];
+		ASSERT_EQ(0, blake2b_hash(b, data.data(), v.len, hash));
+		ASSERT_EQ(0, blake2b_hash_to_hex(hash, 64, hex));
+		ASSERT_STRCASEEQ(v.hash, hex) << "len " << v.len;
+
+		ASSERT_EQ(0, blake2b_reset(b));
+		ASSERT_EQ(0, blake2b_update(b, data.data(), v.len));
+		ASSERT_EQ(0, blake2b_final(b, hash));
+		ASSERT_EQ(0, blake2b_hash_to_hex(hash, 64, hex));
+		ASSERT_STRCASEEQ(v.hash, hex) << "incremental len " << v.len;
+	}
+
+	ASSERT_EQ(-1, blake2b_set_key(b, key, 65));
+}
+
+TEST_F(Blake2bTest, exportedStateHidesKey) {
+	const char key[] = "a secret key of thirty-two bytes";
+	ASSERT_EQ(0, blake2b_set_key(b, key, 32));
+
+	std::string data(300, 'd');
+	for (auto len : {size_t{0}, size_t{3}, size_t{128}, size_t{129}, size_t{300}}) {
+		ASSERT_EQ(0, blake2b_reset(b));
+		ASSERT_EQ(0, blake2b_update(b, data.data(), len));
+
+		std::vector<uint8_t> state(BLAKE2B_STATE_SIZE);
+		ASSERT_EQ(0, blake2b_export_state(b, state.data(), state.size()));
+		for (auto i = size_t{0}; i + 4 <= 32; ++i)
+			ASSERT_EQ(nullptr, memmem(state.data(), state.size(), key + i, 4)) << len << " " << i;
+
+		// resumes with the key of the importing object
+		blake2b *c = blake2b_new();
+		ASSERT_EQ(-1, blake2b_import_state(c, state.data(), state.size()));
+		ASSERT_EQ(0, blake2b_set_key(c, key, 32));
+		ASSERT_EQ(0, blake2b_import_state(c, state.data(), state.size()));
+		ASSERT_EQ(0, blake2b_update(c, "tail", 4));
+
+		uint8_t expected[64], hash[64];
+		auto message = data.substr(0, len) + "tail";
+		ASSERT_EQ(0, blake2b_hash(b, message.data(), message.size(), expected));
+		ASSERT_EQ(0, blake2b_final(c, hash));
+		ASSERT_EQ(0, memcmp(expected, hash, 64)) << len;
+		blake2b_delete(c);
+	}
+}
+
+TEST(testBlake2b, hasher) {
+	auto key = Blake2::Blake2bHasher::key_t();
+	memcpy(key.data(), "0123456789abcdef", 16);
+	auto hasher = Blake2::Blake2bHasher(key);
+
+	ASSERT_EQ(0x81a49b3a785cf68dULL, hasher(std::string("The quick brown fox jumps over the lazy dog")));
+	ASSERT_EQ(0x2aa869b6ef45de45ULL, hasher(std::string()));
+	ASSERT_EQ(0xa4a59f6426edfdb0ULL, hasher(std::string(128, 'x')));
+	ASSERT_EQ(0xf9cd029e2b32235dULL, hasher(std::string(200, 'x')));
+
+	std::unordered_map<std::string, int, Blake2::Blake2bHasher> map;
+	map["one"] = 1;
+	map["two"] = 2;
+	ASSERT_EQ(1, map["one"]);
+	ASSERT_EQ(2, map["two"]);
+
+	std::unordered_map<uint64_t, int, Blake2::Blake2bHasher> int_map;
+	int_map[42] = 42;
+	ASSERT_EQ(42, int_map[42]);
+
+	enum class Color { red, green };
+	std::unordered_map<Color, int, Blake2::Blake2bHasher> enum_map;
+	enum_map[Color::green] = 2;
+	ASSERT_EQ(1u, enum_map.count(Color::green));
+	ASSERT_EQ(0u, enum_map.count(Color::red));
+}
+
+TEST(testBlake2b, async) {
+	std::string data(10000, 'a');
+	auto expected = Blake2::Blake2b()(data);
+
+	Blake2::AsyncBlake2b a;
+	ASSERT_EQ(expected, a.hash_async(data.data(), data.size()).get());
+
+	auto first = a.update(data.data(), 4000);
+	auto second = a.update(data.data() + 4000, 6000);
+	auto h = a.final();
+	first.get();
+	second.get();
+	ASSERT_EQ(expected, h.get());
+
+	// the state is reset after final()
+	a.update(data.data(), data.size());
+	ASSERT_EQ(expected, a.final().get());
+}
+
+TEST(testBlake2b, asyncCustomExecutor) {
+	std::string data(300, 'b');
+	auto expected = Blake2::Blake2b()(data);
+
+	auto tasks = 0u;
+	Blake2::AsyncBlake2b a(Blake2::Blake2b(), [&tasks](Blake2::AsyncBlake2b::task_t task) {
+		++tasks;
+		task();
+	});
+	a.update(data.data(), 100);
+	a.update(data.data() + 100, 200);
+	ASSERT_EQ(expected, a.final().get());
+	ASSERT_EQ(3u, tasks);
+}
+
+TEST(testBlake2b, asyncCallbacks) {
+	std::string data(300, 'c');
+	auto expected = Blake2::Blake2b()(data);
+
+	std::vector<Blake2::AsyncBlake2b::task_t> tasks;
+	Blake2::AsyncBlake2b a(Blake2::Blake2b(), [&tasks](Blake2::AsyncBlake2b::task_t task) {
+		tasks.push_back(task);
+	});
+
+	auto updates = 0u;
+	Blake2::AsyncBlake2b::hash_t one_shot{}, incremental{};
+	auto errors = 0u;
+	auto on_error = [&errors](std::exception_ptr) {
+		++errors;
+	};
+	a.hash_async(data.data(), data.size(), [&one_shot](const Blake2::AsyncBlake2b::hash_t &h) {
+		one_shot = h;
+	}, on_error);
+	a.update(data.data(), 100, [&updates]() {
+		++updates;
+	}, on_error);
+	a.update(data.data() + 100, 200, [&updates]() {
+		++updates;
+	}, on_error);
+	a.final([&incremental](const Blake2::AsyncBlake2b::hash_t &h) {
+		incremental = h;
+	}, on_error);
+
+	// nothing runs before the executor does
+	ASSERT_EQ(0u, updates);
+	for (auto i = size_t{0}; i < tasks.size(); ++i)
+		tasks[i]();
+	ASSERT_EQ(2u, updates);
+	ASSERT_EQ(expected, one_shot);
+	ASSERT_EQ(expected, incremental);
+	ASSERT_EQ(0u, errors);
+}
+
+TEST(testBlake2b, asyncCallbackDestroys) {
+	std::string data(300, 'c');
+	auto expected = Blake2::Blake2b()(data);
+
+	// a coroutine resumed from final() typically ends and destroys it
+	auto a = std::unique_ptr<Blake2::AsyncBlake2b>(new Blake2::AsyncBlake2b());
+	std::promise<Blake2::AsyncBlake2b::hash_t> done;
+	a->update(data.data(), data.size());
+	a->final([&a, &done](const Blake2::AsyncBlake2b::hash_t &h) {
+		a.reset();
+		done.set_value(h);
+	}, nullptr);
+
+	auto f = done.get_future();
+	ASSERT_EQ(std::future_status::ready, f.wait_for(std::chrono::seconds(10)));
+	ASSERT_EQ(expected, f.get());
+}
+
+TEST(testBlake2b, asyncCallbackThrows) {
+	std::string data(300, 'c');
+	auto expected = Blake2::Blake2b()(data);
+
+	Blake2::AsyncBlake2b a;
+	std::promise<std::exception_ptr> error;
+	a.update(data.data(), data.size(), []() {
+		throw std::runtime_error("callback failed");
+	}, [&error](std::exception_ptr e) {
+		error.set_value(e);
+	});
+	ASSERT_THROW(std::rethrow_exception(error.get_future().get()), std::runtime_error);
+
+	// the queue keeps working
+	ASSERT_EQ(expected, a.final().get());
+}
+
+TEST_F(Blake2bTest, daemonFallback) {
+	setenv("BLAKE2BD_SOCKET", "/nonexistent/blake2bd.sock", 1);
+	std::string data(100000, 'd');
+	for (auto len : {size_t{0}, size_t{43}, data.size()}) {
+		uint8_t expected[64], hash[64];
+		ASSERT_EQ(0, blake2b_hash(b, data.data(), len, expected));
+		ASSERT_EQ(0, blake2b_hash_daemon(b, data.data(), len, hash));
+		ASSERT_EQ(0, memcmp(expected, hash, 64));
+	}
+}
+
 TEST(testBlake2b, hexBinConvert) {
 	uint8_t hash[64];
 	auto ret = blake2b_hex_to_hash(empty_hash, 129, hash, 64);
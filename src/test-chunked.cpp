@@ -0,0 +1,173 @@
+/***
+  This file is part of libblake2
+
+  Copyright 2015 Mirco Tischler
+
+  libblake2 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  libblake2 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with libblake2; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#include <gtest/gtest.h>
+
+#include "ChunkedContainer.hpp"
+
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+using Blake2::ChunkedContainer;
+
+std::string data(const size_t &len) {
+	std::string d(len, '\0');
+	for (auto i = size_t{0}; i < len; ++i)
+		d[i] = static_cast<char> (i * 7);
+	return d;
+}
+
+TEST(testChunked, roundTrip) {
+	ChunkedContainer c("container key", {}, {}, 1000);
+	for (auto len : {size_t{0}, size_t{1}, size_t{999}, size_t{1000}, size_t{1001}, size_t{12345}}) {
+		auto container = c.encode(data(len));
+		auto header = ChunkedContainer::parse_header(container.data(), container.size());
+		ASSERT_EQ(len, header.data_length);
+		ASSERT_EQ(container.size(), header.container_length());
+		ASSERT_TRUE(c.verify(container)) << len;
+		ASSERT_EQ(data(len), c.decode(container)) << len;
+	}
+}
+
+// checked against Python's hashlib.blake2b
+TEST(testChunked, knownRoot) {
+	ChunkedContainer c("container key", {0x746c6173}, {0x6e6f73726570}, 4);
+	auto d = data(10);
+	auto container = c.encode(d.data(), d.size(), {0x0706050403020100, 0x0f0e0d0c0b0a0908});
+	auto header = ChunkedContainer::parse_header(container.data(), container.size());
+	ASSERT_EQ(3u, header.chunk_count());
+	ASSERT_EQ(0x0f0e0d0c0b0a0908u, header.nonce[1]);
+
+	ChunkedContainer::tag_t root;
+	memcpy(root.data(), container.data() + header.root_offset(), ChunkedContainer::tag_size);
+	ASSERT_EQ("f24af4ce916cf0b4f096be52cac7a74bcac9e2a5867fd139ade4b3e016b076ed"
+		  "92a9068fda1d79b69a4497565ea4823f9bb4d7f4bea1bc5c31f3ccfebd783cdc",
+		  Blake2::Blake2b::to_string(root));
+}
+
+TEST(testChunked, detectsModification) {
+	ChunkedContainer c("container key", {}, {}, 1000);
+	auto container = c.encode(data(10000));
+	auto header = ChunkedContainer::parse_header(container.data(), container.size());
+
+	auto flipped = container;
+	flipped[header.chunk_offset(3) + 17] ^= 1;
+	ASSERT_FALSE(c.verify(flipped));
+
+	// swapping two chunks together with their tags breaks the index binding
+	auto swapped = container;
+	swapped.replace(header.tag_offset(1), ChunkedContainer::tag_size, container, header.tag_offset(2), ChunkedContainer::tag_size);
+	swapped.replace(header.tag_offset(2), ChunkedContainer::tag_size, container, header.tag_offset(1), ChunkedContainer::tag_size);
+	swapped.replace(header.chunk_offset(1), 1000, container, header.chunk_offset(2), 1000);
+	swapped.replace(header.chunk_offset(2), 1000, container, header.chunk_offset(1), 1000);
+	ASSERT_FALSE(c.verify(swapped));
+
+	auto root = container;
+	root[header.root_offset()] ^= 1;
+	ASSERT_FALSE(c.verify(root));
+
+	ASSERT_FALSE(c.verify(container.substr(0, container.size() - 1)));
+	ASSERT_FALSE(ChunkedContainer("other key", {}, {}, 1000).verify(container));
+	ASSERT_FALSE(ChunkedContainer("container key", {1}, {}, 1000).verify(container));
+	ASSERT_FALSE(ChunkedContainer("container key", {}, {1}, 1000).verify(container));
+	ASSERT_THROW(c.decode(flipped), std::invalid_argument);
+}
+
+// chunks of another container of the same size under the same key are
+// bound to that container's nonce
+TEST(testChunked, rejectsSplicedChunks) {
+	ChunkedContainer c("container key", {}, {}, 1000);
+	auto d = data(10000);
+	auto container = c.encode(d);
+	auto other = c.encode(std::string(10000, 'x'));
+	auto header = ChunkedContainer::parse_header(container.data(), container.size());
+	ASSERT_NE(header.nonce, ChunkedContainer::parse_header(other.data(), other.size()).nonce);
+
+	auto spliced = container;
+	spliced.replace(header.tag_offset(3), ChunkedContainer::tag_size, other, header.tag_offset(3), ChunkedContainer::tag_size);
+	spliced.replace(header.chunk_offset(3), 1000, other, header.chunk_offset(3), 1000);
+	ASSERT_THROW(c.read_range(spliced, 3000, 10), std::invalid_argument);
+	ASSERT_EQ(d.substr(0, 3000), c.read_range(spliced, 0, 3000));
+	ASSERT_FALSE(c.verify(spliced));
+
+	// a repeated nonce gives the same tags
+	ASSERT_EQ(c.encode(d.data(), d.size(), header.nonce), container);
+}
+
+TEST(testChunked, readRange) {
+	ChunkedContainer c("container key", {}, {}, 1000);
+	auto d = data(10000);
+	auto container = c.encode(d);
+	auto header = ChunkedContainer::parse_header(container.data(), container.size());
+
+	ASSERT_EQ(d.substr(0, 10), c.read_range(container, 0, 10));
+	ASSERT_EQ(d.substr(990, 2020), c.read_range(container, 990, 2020));
+	ASSERT_EQ(d.substr(9999, 1), c.read_range(container, 9999, 1));
+	ASSERT_EQ("", c.read_range(container, 10000, 0));
+	ASSERT_THROW(c.read_range(container, 9999, 2), std::out_of_range);
+
+	// only the chunks a range touches are checked
+	container[header.chunk_offset(5)] ^= 1;
+	ASSERT_EQ(d.substr(1000, 4000), c.read_range(container, 1000, 4000));
+	ASSERT_THROW(c.read_range(container, 4999, 2), std::invalid_argument);
+}
+
+TEST(testChunked, verifyChunk) {
+	ChunkedContainer c("container key", {}, {}, 1000);
+	auto container = c.encode(data(2500));
+	auto header = ChunkedContainer::parse_header(container.data(), container.size());
+
+	ASSERT_TRUE(c.verify_chunk(header, 2, container.data() + header.chunk_offset(2), 500,
+				   container.data() + header.tag_offset(2)));
+	ASSERT_FALSE(c.verify_chunk(header, 1, container.data() + header.chunk_offset(2), 500,
+				    container.data() + header.tag_offset(2)));
+	ASSERT_FALSE(c.verify_chunk(header, 3, container.data() + header.chunk_offset(2), 500,
+				    container.data() + header.tag_offset(2)));
+}
+
+TEST(testChunked, invalidParameters) {
+	ASSERT_THROW(ChunkedContainer(""), std::invalid_argument);
+	ASSERT_THROW(ChunkedContainer("key", {}, {}, 0), std::invalid_argument);
+	ASSERT_THROW(ChunkedContainer::parse_header("B2bX", 4), std::invalid_argument);
+	ASSERT_THROW(ChunkedContainer("key").decode(std::string(40, '\0')), std::invalid_argument);
+}
+
+// lengths whose chunk count or container length would wrap around
+TEST(testChunked, rejectsOverflowingLength) {
+	ChunkedContainer c("key", {}, {}, 2);
+	auto container = c.encode(data(10));
+
+	for (auto length : {~0ULL, ~0ULL - 1, ~0ULL / 2, ~0ULL - 1000}) {
+		auto junk = container.substr(0, 95);
+		for (auto i = 0u; i < 8; ++i)
+			junk[16 + i] = static_cast<char> (length >> (8 * i));
+		ASSERT_THROW(ChunkedContainer::parse_header(junk.data(), junk.size()), std::invalid_argument) << length;
+		ASSERT_THROW(c.decode(junk), std::invalid_argument);
+		ASSERT_THROW(c.read_range(junk, 0, 1), std::invalid_argument);
+	}
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
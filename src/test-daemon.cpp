@@ -0,0 +1,208 @@
+/***
+  This file is part of libblake2
+
+  Copyright 2015 Mirco Tischler
+
+  libblake2 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  libblake2 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with libblake2; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#include <gtest/gtest.h>
+
+#include "blake2b.h"
+#include "blake2bd-protocol.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+// runs ./blake2bd on a private socket for the tests
+class DaemonTest : public ::testing::Test {
+    protected:
+
+	static void SetUpTestCase() {
+		char dir[] = "/tmp/test-daemon.XXXXXX";
+		ASSERT_NE(nullptr, mkdtemp(dir));
+		directory = dir;
+		path = directory + "/blake2bd.sock";
+		setenv("BLAKE2BD_SOCKET", path.c_str(), 1);
+
+		daemon = fork();
+		ASSERT_LE(0, daemon);
+		if (daemon == 0) {
+			execl("./blake2bd", "blake2bd", "-s", path.c_str(), "-j", "2", static_cast<char *> (nullptr));
+			_exit(127);
+		}
+
+		// wait until it accepts connections
+		for (auto i = 0; i < 500; ++i) {
+			auto fd = connect_daemon();
+			if (fd >= 0) {
+				close(fd);
+				return;
+			}
+			usleep(10000);
+		}
+		FAIL() << "blake2bd didn't start";
+	}
+
+	static void TearDownTestCase() {
+		if (daemon > 0) {
+			kill(daemon, SIGTERM);
+			waitpid(daemon, nullptr, 0);
+		}
+		unlink(path.c_str());
+		rmdir(directory.c_str());
+	}
+
+	static int connect_daemon() {
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strcpy(addr.sun_path, path.c_str());
+
+		auto fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+		if (fd >= 0 && connect(fd, reinterpret_cast<struct sockaddr *> (&addr), sizeof(addr)) != 0) {
+			close(fd);
+			fd = -1;
+		}
+		return fd;
+	}
+
+	// an inline request to hash data with the default parameters
+	static std::string request(const std::string &data) {
+		struct blake2bd_request r;
+		memset(&r, 0, sizeof(r));
+		r.magic = BLAKE2BD_MAGIC;
+		r.version = BLAKE2BD_VERSION;
+		r.length = data.size();
+		r.inline_payload = 1;
+		auto b = blake2b_new();
+		blake2b_export_state(b, r.state, sizeof(r.state));
+		blake2b_delete(b);
+
+		return std::string(reinterpret_cast<const char *> (&r), sizeof(r)) + data;
+	}
+
+	static std::string expected(const std::string &data) {
+		uint8_t hash[64];
+		auto b = blake2b_new();
+		blake2b_hash(b, data.data(), data.size(), hash);
+		blake2b_delete(b);
+		return std::string(reinterpret_cast<const char *> (hash), sizeof(hash));
+	}
+
+	// sends a request on fd and waits up to two seconds for the response
+	static bool exchange(const int &fd, const std::string &message, struct blake2bd_response &response) {
+		if (send(fd, message.data(), message.size(), MSG_NOSIGNAL) != static_cast<ssize_t> (message.size()))
+			return false;
+		struct pollfd p = {fd, POLLIN, 0};
+		return poll(&p, 1, 2000) == 1 &&
+			recv(fd, &response, sizeof(response), 0) == sizeof(response);
+	}
+
+	static std::string directory;
+	static std::string path;
+	static pid_t daemon;
+};
+
+std::string DaemonTest::directory;
+std::string DaemonTest::path;
+pid_t DaemonTest::daemon = -1;
+
+TEST_F(DaemonTest, hashesRequests) {
+	auto fd = connect_daemon();
+	ASSERT_LE(0, fd);
+	for (auto len : {size_t{0}, size_t{43}, size_t{BLAKE2BD_INLINE_MAX}}) {
+		auto data = std::string(len, 'd');
+		struct blake2bd_response response;
+		ASSERT_TRUE(exchange(fd, request(data), response)) << len;
+		ASSERT_EQ(0, response.status);
+		ASSERT_EQ(expected(data), std::string(reinterpret_cast<const char *> (response.hash), 64));
+	}
+	close(fd);
+
+	// larger payloads go through a memfd
+	auto data = std::string(100000, 'm');
+	uint8_t hash[64];
+	auto b = blake2b_new();
+	ASSERT_EQ(0, blake2b_hash_daemon(b, data.data(), data.size(), hash));
+	blake2b_delete(b);
+	ASSERT_EQ(expected(data), std::string(reinterpret_cast<const char *> (hash), 64));
+}
+
+TEST_F(DaemonTest, refusesUsedState) {
+	auto fd = connect_daemon();
+	ASSERT_LE(0, fd);
+	auto message = request("abc");
+	// a counter that isn't zero
+	message[offsetof(struct blake2bd_request, state) + 136] = 1;
+	struct blake2bd_response response;
+	ASSERT_TRUE(exchange(fd, message, response));
+	ASSERT_NE(0, response.status);
+	close(fd);
+}
+
+// a client that sends requests without reading the replies is dropped,
+// and clients that do read keep getting served in the meantime
+TEST_F(DaemonTest, dropsClientNotReading) {
+	auto flood = connect_daemon();
+	auto other = connect_daemon();
+	ASSERT_LE(0, flood);
+	ASSERT_LE(0, other);
+	auto message = request(std::string(100, 'f'));
+	struct blake2bd_response response;
+
+	auto served = false;
+	auto dropped = false;
+	auto start = std::chrono::steady_clock::now();
+	while (!dropped && std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+		if (send(flood, message.data(), message.size(), MSG_NOSIGNAL | MSG_DONTWAIT) >= 0)
+			continue;
+		if (errno != EAGAIN) {
+			dropped = true;
+		} else if (!served) {
+			// the flooding client's queues are full now
+			ASSERT_TRUE(exchange(other, request("abc"), response));
+			ASSERT_EQ(0, response.status);
+			served = true;
+		} else {
+			usleep(1000);
+		}
+	}
+	ASSERT_TRUE(dropped);
+	close(flood);
+
+	ASSERT_TRUE(exchange(other, request("abc"), response));
+	ASSERT_EQ(0, response.status);
+	close(other);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,115 @@
+/***
+  This file is part of libblake2
+
+  Copyright 2015 Mirco Tischler
+
+  libblake2 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  libblake2 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with libblake2; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#include <gtest/gtest.h>
+
+#include "Filters.hpp"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+using Blake2::BloomFilter;
+using Blake2::CuckooFilter;
+
+std::vector<std::string> items(const std::string &prefix, const unsigned int &n) {
+	std::vector<std::string> result;
+	for (auto i = 0u; i < n; ++i)
+		result.push_back(prefix + std::to_string(i));
+	return result;
+}
+
+TEST(testFilters, bloom) {
+	BloomFilter f(10000 * 10, 7, "secret key");
+	auto in = items("in ", 10000);
+	for (const auto &i : in)
+		f.insert(i);
+	for (const auto &i : in)
+		ASSERT_TRUE(f.contains(i));
+
+	auto false_positives = 0u;
+	for (const auto &i : items("out ", 10000))
+		false_positives += f.contains(i);
+	// about 1% expected at 10 bits per key
+	ASSERT_LT(false_positives, 300u);
+}
+
+TEST(testFilters, bloomBatch) {
+	BloomFilter single(8192, 4, "k");
+	BloomFilter batched(8192, 4, "k");
+	auto in = items("", 500);
+	for (const auto &i : in)
+		single.insert(i);
+	batched.insert(in);
+
+	auto probe = items("", 1000);
+	auto found = batched.contains(probe);
+	for (auto i = 0u; i < probe.size(); ++i)
+		ASSERT_EQ(single.contains(probe[i]), found[i]);
+	ASSERT_THROW(BloomFilter(8192, 0, "k"), std::invalid_argument);
+	ASSERT_THROW(BloomFilter(8192, 7, ""), std::invalid_argument);
+	ASSERT_THROW(CuckooFilter(1000, ""), std::invalid_argument);
+}
+
+TEST(testFilters, cuckoo) {
+	CuckooFilter f(10000, "secret key");
+	auto in = items("in ", 9000);
+	for (const auto &i : in)
+		ASSERT_TRUE(f.insert(i));
+	for (const auto &i : in)
+		ASSERT_TRUE(f.contains(i));
+
+	auto false_positives = 0u;
+	for (const auto &i : items("out ", 10000))
+		false_positives += f.contains(i);
+	ASSERT_LT(false_positives, 100u);
+
+	for (auto i = 0u; i < in.size(); i += 2)
+		ASSERT_TRUE(f.remove(in[i]));
+	for (auto i = 1u; i < in.size(); i += 2)
+		ASSERT_TRUE(f.contains(in[i]));
+}
+
+TEST(testFilters, cuckooFull) {
+	CuckooFilter f(64, "k");
+	auto in = items("", 1000);
+	auto inserted = f.insert(in);
+	auto n = 0u;
+	for (auto i = 0u; i < in.size(); ++i) {
+		if (!inserted[i])
+			break;
+		++n;
+	}
+	ASSERT_GE(n, 50u);
+	ASSERT_LT(n, 1000u);
+
+	// no false negatives for anything that was accepted
+	auto found = f.contains(in);
+	for (auto i = 0u; i < n; ++i)
+		ASSERT_TRUE(found[i]);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	::testing::InitGoogleTest(&argc, argv);
+
+	return RUN_ALL_TESTS();
+}
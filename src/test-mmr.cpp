@@ -0,0 +1,95 @@
+/***
+  This file is part of libblake2
+
+  Copyright 2015 Mirco Tischler
+
+  libblake2 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  libblake2 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with libblake2; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#include <gtest/gtest.h>
+
+#include "MerkleMountainRange.hpp"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+using Blake2::MerkleMountainRange;
+
+std::string entry(const unsigned int &i) {
+	return "entry " + std::to_string(i);
+}
+
+TEST(testMmr, rootChanges) {
+	MerkleMountainRange mmr;
+	auto empty = mmr.root();
+	mmr.append(entry(0));
+	auto one = mmr.root();
+	ASSERT_NE(empty, one);
+	mmr.append(entry(1));
+	ASSERT_NE(one, mmr.root());
+	ASSERT_EQ(2u, mmr.size());
+}
+
+TEST(testMmr, inclusion) {
+	MerkleMountainRange mmr;
+	for (auto n = 1u; n <= 33; ++n) {
+		mmr.append(entry(n - 1));
+		auto root = mmr.root();
+		for (auto i = 0u; i < n; ++i) {
+			auto proof = mmr.prove_inclusion(i);
+			ASSERT_TRUE(MerkleMountainRange::verify_inclusion(root, entry(i), proof)) << n << " " << i;
+			ASSERT_FALSE(MerkleMountainRange::verify_inclusion(root, entry(i + 1), proof)) << n << " " << i;
+		}
+	}
+}
+
+TEST(testMmr, consistency) {
+	MerkleMountainRange mmr;
+	std::vector<MerkleMountainRange::hash_t> roots;
+	for (auto n = 1u; n <= 33; ++n) {
+		mmr.append(entry(n - 1));
+		roots.push_back(mmr.root());
+		for (auto m = 1u; m <= n; ++m) {
+			auto proof = mmr.prove_consistency(m);
+			ASSERT_TRUE(MerkleMountainRange::verify_consistency(roots[m - 1], roots.back(), proof)) << m << " " << n;
+			if (m > 1) {
+				ASSERT_FALSE(MerkleMountainRange::verify_consistency(roots[m - 2], roots.back(), proof)) << m << " " << n;
+			}
+		}
+	}
+}
+
+TEST(testMmr, batchAppend) {
+	std::vector<std::string> entries;
+	MerkleMountainRange sequential;
+	for (auto i = 0u; i < 1000; ++i) {
+		entries.push_back(entry(i));
+		sequential.append(entries.back());
+	}
+
+	MerkleMountainRange batched;
+	batched.append(entries);
+	ASSERT_EQ(sequential.size(), batched.size());
+	ASSERT_EQ(sequential.root(), batched.root());
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	::testing::InitGoogleTest(&argc, argv);
+
+	return RUN_ALL_TESTS();
+}